@@ -0,0 +1,47 @@
+/**
+  ******************************************************************************
+  * @file    sim.h
+  * @author  lizdDong
+  * @version V1.0
+  * @date    2026-10-17
+  * @brief   Hooks of the host peripherals of stm32f10x_sim.c, the tests play
+  *          the part of the hardware with them.
+  * @attention
+  *
+  ******************************************************************************
+  */
+
+#ifndef _SIM_H_
+#define _SIM_H_
+
+#include "stm32f10x.h"
+
+
+/* Counted by sim_tickStart(), read by dev_timer.c */
+extern __IO uint32_t gMsCounter;
+
+/* Called by USART_SendData(), 0: the byte is dropped */
+extern void (*sim_usartTx)(USART_TypeDef *usart, uint8_t c);
+
+/* Counted by the controller of sim_flashProtect() */
+typedef struct
+{
+    uint32_t erases;                /* pages */
+    uint32_t programs;              /* half words */
+    uint32_t errors;                /* half words refused */
+    uint32_t operations;            /* erases and half words tried */
+    uint32_t fail_at;               /* operation raising an error, 0: none */
+} sim_flashStat_t;
+
+extern sim_flashStat_t SimFlashStat;
+
+void sim_flashMap(void);
+void sim_flashProtect(uint32_t on);
+uint32_t sim_flashPoll(void);
+void sim_dmaPut(DMA_Channel_TypeDef *ch, uint8_t c);
+void sim_tickStart(void);
+
+
+#endif
+
+/****************************** End of file ***********************************/
@@ -0,0 +1,143 @@
+/**
+  ******************************************************************************
+  * @file    stm32f10x.h
+  * @author  lizdDong
+  * @version V1.0
+  * @date    2026-10-17
+  * @brief   Host stand-in of the CMSIS device header for the unit tests.
+  *          The peripherals are plain structures in stm32f10x_sim.c, see
+  *          sim.h for the hooks the tests drive them with.
+  * @attention
+  *
+  ******************************************************************************
+  */
+
+#ifndef __STM32F10x_H
+#define __STM32F10x_H
+
+#include <stdint.h>
+#define __IO volatile
+#define __I volatile const
+#define __O volatile
+#define __INLINE inline
+#define __STATIC_INLINE static inline
+typedef enum {RESET = 0, SET = !RESET} FlagStatus, ITStatus;
+typedef enum {DISABLE = 0, ENABLE = !DISABLE} FunctionalState;
+typedef enum {ERROR = 0, SUCCESS = !ERROR} ErrorStatus;
+typedef enum { FLASH_BUSY = 1, FLASH_ERROR_PG, FLASH_ERROR_WRP, FLASH_COMPLETE, FLASH_TIMEOUT } FLASH_Status;
+typedef int IRQn_Type;
+#define USART1_IRQn 37
+#define USART3_IRQn 39
+#define FLASH_IRQn 4
+#define DMA1_Channel3_IRQn 13
+#define DMA1_Channel5_IRQn 15
+typedef struct { __IO uint32_t ACR, KEYR, OPTKEYR, SR, CR, AR, RESERVED, OBR, WRPR; } FLASH_TypeDef;
+typedef struct { __IO uint16_t SR; uint16_t r0; __IO uint16_t DR; uint16_t r1; __IO uint16_t BRR; uint16_t r2; __IO uint16_t CR1; uint16_t r3; __IO uint16_t CR2; uint16_t r4; __IO uint16_t CR3; uint16_t r5; __IO uint16_t GTPR; uint16_t r6; } USART_TypeDef;
+typedef struct { __IO uint32_t CCR, CNDTR, CPAR, CMAR; } DMA_Channel_TypeDef;
+typedef struct { __IO uint32_t ISR, IFCR; } DMA_TypeDef;
+typedef struct { __IO uint32_t CTRL, LOAD, VAL; __I uint32_t CALIB; } SysTick_Type;
+typedef struct { __I uint32_t CPUID; __IO uint32_t ICSR, VTOR, AIRCR, SCR, CCR; __IO uint8_t SHP[12]; __IO uint32_t SHCSR; } SCB_Type;
+typedef struct { __IO uint32_t CTRL, CYCCNT; } DWT_Type;
+typedef struct { __IO uint32_t DHCSR, DCRSR, DCRDR, DEMCR; } CoreDebug_Type;
+typedef struct { __IO uint32_t DR, IDR, CR; } CRC_TypeDef;
+typedef struct { __IO uint32_t KR, PR, RLR, SR; } IWDG_TypeDef;
+typedef struct { __IO uint32_t CRL, CRH, IDR, ODR, BSRR, BRR, LCKR; } GPIO_TypeDef;
+extern FLASH_TypeDef *FLASH; extern USART_TypeDef *USART1, *USART3; extern DMA_TypeDef *DMA1;
+extern DMA_Channel_TypeDef *DMA1_Channel3, *DMA1_Channel5; extern SysTick_Type *SysTick; extern SCB_Type *SCB;
+extern DWT_Type *DWT; extern CoreDebug_Type *CoreDebug; extern CRC_TypeDef *CRC; extern GPIO_TypeDef *GPIOA, *GPIOB;
+extern IWDG_TypeDef *IWDG;
+#define FLASH_BASE ((uint32_t)0x08000000)
+#define SRAM_BASE ((uint32_t)0x20000000)
+#define FLASH_BANK1_END_ADDRESS ((uint32_t)0x807FFFF)
+#define FLASH_CR_PG ((uint16_t)0x0001)
+#define FLASH_CR_PER ((uint16_t)0x0002)
+#define FLASH_CR_MER ((uint16_t)0x0004)
+#define FLASH_CR_STRT ((uint16_t)0x0040)
+#define FLASH_CR_LOCK ((uint16_t)0x0080)
+#define FLASH_CR_ERRIE ((uint16_t)0x0400)
+#define FLASH_CR_EOPIE ((uint16_t)0x1000)
+#define FLASH_SR_BSY ((uint8_t)0x01)
+#define FLASH_SR_PGERR ((uint8_t)0x04)
+#define FLASH_SR_WRPRTERR ((uint8_t)0x10)
+#define FLASH_SR_EOP ((uint8_t)0x20)
+#define FLASH_FLAG_BSY 1
+#define FLASH_FLAG_EOP 0x20
+#define FLASH_FLAG_PGERR 4
+#define FLASH_FLAG_WRPRTERR 0x10
+#define FLASH_KEY1 ((uint32_t)0x45670123)
+#define FLASH_KEY2 ((uint32_t)0xCDEF89AB)
+#define USART_FLAG_RXNE 0x20
+#define USART_FLAG_TC 0x40
+#define USART_FLAG_TXE 0x80
+#define USART_FLAG_ORE 0x08
+#define USART_FLAG_IDLE 0x10
+#define USART_DMAReq_Rx 0x40
+#define USART_IT_IDLE 0x0424
+#define USART_CR3_DMAR 0x40
+#define DMA_CCR1_EN 1
+#define DMA_CCR1_CIRC 0x20
+#define DMA_CCR1_MINC 0x80
+#define SysTick_CTRL_ENABLE_Msk 1
+#define DWT_CTRL_CYCCNTENA_Msk 1
+#define CoreDebug_DEMCR_TRCENA_Msk (1UL << 24)
+#define RCC_AHBPeriph_DMA1 1
+#define RCC_AHBPeriph_CRC 0x40
+#define CRC_CR_RESET 1
+#define RCC_APB2Periph_GPIOA 4
+#define RCC_APB2Periph_GPIOB 8
+#define RCC_APB2Periph_AFIO 1
+#define RCC_APB2Periph_USART1 0x4000
+#define RCC_APB1Periph_USART3 0x40000
+#define GPIO_Pin_4 0x10
+#define GPIO_Pin_8 0x100
+#define GPIO_Pin_9 0x200
+#define GPIO_Pin_10 0x400
+#define GPIO_Pin_11 0x800
+#define GPIO_Pin_15 0x8000
+#define GPIO_Remap_SWJ_JTAGDisable 1
+#define GPIO_Remap_SWJ_NoJTRST 2
+typedef enum { GPIO_Speed_50MHz = 3 } GPIOSpeed_TypeDef;
+typedef enum { GPIO_Mode_IN_FLOATING = 4, GPIO_Mode_Out_PP = 0x10, GPIO_Mode_AF_PP = 0x18 } GPIOMode_TypeDef;
+typedef struct { uint16_t GPIO_Pin; GPIOSpeed_TypeDef GPIO_Speed; GPIOMode_TypeDef GPIO_Mode; } GPIO_InitTypeDef;
+typedef struct { uint32_t USART_BaudRate; uint16_t USART_WordLength, USART_StopBits, USART_Parity, USART_Mode, USART_HardwareFlowControl; } USART_InitTypeDef;
+#define USART_WordLength_8b 0
+#define USART_StopBits_1 0
+#define USART_Parity_No 0
+#define USART_HardwareFlowControl_None 0
+#define USART_Mode_Rx 4
+#define USART_Mode_Tx 8
+typedef struct { uint32_t DMA_PeripheralBaseAddr, DMA_MemoryBaseAddr, DMA_DIR, DMA_BufferSize, DMA_PeripheralInc, DMA_MemoryInc, DMA_PeripheralDataSize, DMA_MemoryDataSize, DMA_Mode, DMA_Priority, DMA_M2M; } DMA_InitTypeDef;
+#define DMA_DIR_PeripheralSRC 0
+#define DMA_PeripheralInc_Disable 0
+#define DMA_MemoryInc_Enable 0x80
+#define DMA_PeripheralDataSize_Byte 0
+#define DMA_MemoryDataSize_Byte 0
+#define DMA_Mode_Circular 0x20
+#define DMA_Priority_VeryHigh 0x3000
+#define DMA_Priority_High 0x2000
+#define DMA_M2M_Disable 0
+typedef struct { uint8_t NVIC_IRQChannel, NVIC_IRQChannelPreemptionPriority, NVIC_IRQChannelSubPriority; FunctionalState NVIC_IRQChannelCmd; } NVIC_InitTypeDef;
+void RCC_APB2PeriphClockCmd(uint32_t, FunctionalState); void RCC_APB1PeriphClockCmd(uint32_t, FunctionalState);
+void RCC_AHBPeriphClockCmd(uint32_t, FunctionalState);
+void GPIO_PinRemapConfig(uint32_t, FunctionalState); void GPIO_ResetBits(GPIO_TypeDef*, uint16_t); void GPIO_DeInit(GPIO_TypeDef*);
+void GPIO_Init(GPIO_TypeDef*, GPIO_InitTypeDef*);
+void USART_Init(USART_TypeDef*, USART_InitTypeDef*); void USART_ClearFlag(USART_TypeDef*, uint16_t); void USART_Cmd(USART_TypeDef*, FunctionalState);
+void USART_DeInit(USART_TypeDef*); FlagStatus USART_GetFlagStatus(USART_TypeDef*, uint16_t); void USART_SendData(USART_TypeDef*, uint16_t);
+uint16_t USART_ReceiveData(USART_TypeDef*); void USART_DMACmd(USART_TypeDef*, uint16_t, FunctionalState);
+void USART_ITConfig(USART_TypeDef*, uint16_t, FunctionalState); ITStatus USART_GetITStatus(USART_TypeDef*, uint16_t);
+void DMA_DeInit(DMA_Channel_TypeDef*); void DMA_Init(DMA_Channel_TypeDef*, DMA_InitTypeDef*); void DMA_Cmd(DMA_Channel_TypeDef*, FunctionalState);
+uint16_t DMA_GetCurrDataCounter(DMA_Channel_TypeDef*);
+void NVIC_Init(NVIC_InitTypeDef*); void NVIC_EnableIRQ(IRQn_Type); void NVIC_DisableIRQ(IRQn_Type); void NVIC_ClearPendingIRQ(IRQn_Type);
+void NVIC_SetPriority(IRQn_Type, uint32_t);
+void FLASH_Unlock(void); void FLASH_Lock(void); void FLASH_ClearFlag(uint32_t);
+FLASH_Status FLASH_ErasePage(uint32_t); FLASH_Status FLASH_EraseAllBank1Pages(void); FLASH_Status FLASH_EraseAllPages(void);
+FLASH_Status FLASH_ProgramWord(uint32_t, uint32_t); FLASH_Status FLASH_ProgramHalfWord(uint32_t, uint16_t);
+FLASH_Status FLASH_GetStatus(void); FLASH_Status FLASH_WaitForLastOperation(uint32_t);
+void FLASH_ITConfig(uint32_t, FunctionalState);
+#define FLASH_IT_EOP 0x1000
+#define FLASH_IT_ERROR 0x400
+void CRC_ResetDR(void); uint32_t CRC_CalcBlockCRC(uint32_t*, uint32_t); uint32_t CRC_CalcCRC(uint32_t);
+uint32_t SysTick_Config(uint32_t); void __set_MSP(uint32_t); void __set_PRIMASK(uint32_t); uint32_t __get_PRIMASK(void);
+void __disable_irq(void); void __enable_irq(void); void __DSB(void); void __ISB(void); void __NOP(void); void __WFI(void);
+extern uint32_t SystemCoreClock;
+#endif
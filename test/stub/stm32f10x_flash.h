@@ -0,0 +1,2 @@
+/* Host stand-in, everything is in stm32f10x.h */
+#include "stm32f10x.h"
@@ -0,0 +1,511 @@
+/**
+ ******************************************************************************
+ * @file    stm32f10x_sim.c
+ * @author  lizdDong
+ * @version V1.0
+ * @date    2026-10-17
+ * @brief   Host peripherals of the unit tests. The registers are plain
+ *          memory, the StdPeriph calls the sources make only do what the
+ *          tests look at. The internal flash is mapped at FLASH_BASE by
+ *          sim_flashMap(), the tests are linked without PIE so the SRAM
+ *          buffers handed to the DMA fit in 32 bits as well.
+ *
+ *          With sim_flashProtect(1) the flash and the FLASH registers are
+ *          read only and every store to them is trapped (SIGSEGV), stepped
+ *          (SIGTRAP) and judged like the controller would: SR is write 1 to
+ *          clear, CR only changes once unlocked by the KEYR sequence, STRT
+ *          erases the page of AR, a half word is only programmed with PG
+ *          set and when it reads 0xFFFF (or is cleared to 0), anything else
+ *          is undone and raises PGERR. The operations end at once, their
+ *          interrupt is held until sim_flashPoll(). x86-64 Linux only.
+ * @attention
+ *
+ ******************************************************************************
+ */
+
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <ucontext.h>
+#include <unistd.h>
+#include "stm32f10x.h"
+#include "dev_flash.h"
+#include "sim.h"
+
+
+#define SIM_FLASH_SIZE       ((uint32_t)0x80000)    /* largest part of dev_flash.h */
+#define SIM_PAGE             ((uintptr_t)4096)      /* host page */
+#define SIM_TRAP_SIZE        (16)                   /* widest store looked at */
+#define SIM_EFLAGS_TF        (0x100)
+#define SIM_PROGRAM_CYCLES   (3780)                 /* 52.5us at 72MHz, added to DWT->CYCCNT */
+
+static FLASH_TypeDef SimFlash = {0, 0, 0, 0, FLASH_CR_LOCK, 0, 0, 0, 0};
+static USART_TypeDef SimUsart1, SimUsart3;
+static DMA_TypeDef SimDma1;
+static DMA_Channel_TypeDef SimDma1Channel3, SimDma1Channel5;
+static SysTick_Type SimSysTick;
+static SCB_Type SimScb;
+static DWT_Type SimDwt;
+static CoreDebug_Type SimCoreDebug;
+static CRC_TypeDef SimCrc;
+static GPIO_TypeDef SimGpioA, SimGpioB;
+static IWDG_TypeDef SimIwdg;
+
+FLASH_TypeDef *FLASH = &SimFlash;
+USART_TypeDef *USART1 = &SimUsart1;
+USART_TypeDef *USART3 = &SimUsart3;
+DMA_TypeDef *DMA1 = &SimDma1;
+DMA_Channel_TypeDef *DMA1_Channel3 = &SimDma1Channel3;
+DMA_Channel_TypeDef *DMA1_Channel5 = &SimDma1Channel5;
+SysTick_Type *SysTick = &SimSysTick;
+SCB_Type *SCB = &SimScb;
+DWT_Type *DWT = &SimDwt;
+CoreDebug_Type *CoreDebug = &SimCoreDebug;
+CRC_TypeDef *CRC = &SimCrc;
+GPIO_TypeDef *GPIOA = &SimGpioA;
+GPIO_TypeDef *GPIOB = &SimGpioB;
+IWDG_TypeDef *IWDG = &SimIwdg;
+uint32_t SystemCoreClock = 72000000;
+
+__IO uint32_t gMsCounter = 0;
+void (*sim_usartTx)(USART_TypeDef *usart, uint8_t c) = 0;
+
+sim_flashStat_t SimFlashStat;
+
+static uint32_t SimFlashProtected;
+static uint32_t SimFlashIrqOn;      /* NVIC_EnableIRQ(FLASH_IRQn) */
+static volatile uint32_t SimFlashIrq;   /* FLASH interrupt held */
+static uint32_t SimFlashKey;        /* KEYR sequence so far */
+
+/* The store being stepped */
+static __thread struct
+{
+    uintptr_t addr;
+    uint32_t size;
+    uint8_t old[SIM_TRAP_SIZE];
+    FLASH_TypeDef regs;
+} SimTrap;
+
+extern void FLASH_IRQHandler(void) __attribute__((weak));
+
+/* DMA_BufferSize of the channels, CNDTR is reloaded with it */
+static uint32_t SimDmaSize[2];
+
+static uint32_t *sim_dmaSize(DMA_Channel_TypeDef *ch)
+{
+    return &SimDmaSize[(ch == DMA1_Channel5) ? 1 : 0];
+}
+
+static uint32_t sim_inFlash(uintptr_t addr)
+{
+    return (addr >= FLASH_BASE) && (addr < FLASH_BASE + SIM_FLASH_SIZE);
+}
+
+static uint32_t sim_inRegs(uintptr_t addr)
+{
+    return (addr >= (uintptr_t)FLASH) && (addr < (uintptr_t)FLASH + SIM_PAGE);
+}
+
+/* Something the controller raises, the interrupt is held if enabled */
+static void sim_flashEvent(uint32_t flags)
+{
+    FLASH->SR |= flags;
+    if((((flags & FLASH_SR_EOP) != 0) && ((FLASH->CR & FLASH_CR_EOPIE) != 0)) ||
+       (((flags & (FLASH_SR_PGERR | FLASH_SR_WRPRTERR)) != 0) && ((FLASH->CR & FLASH_CR_ERRIE) != 0)))
+    {
+        SimFlashIrq = 1;
+    }
+}
+
+/* One more operation, 1 if it is the one to fail */
+static uint32_t sim_flashFails(void)
+{
+    return (++SimFlashStat.operations == SimFlashStat.fail_at);
+}
+
+/* A store to the FLASH registers */
+static void sim_flashRegs(uintptr_t addr, const FLASH_TypeDef *old)
+{
+    uint32_t cr = FLASH->CR, page;
+
+    if(addr == (uintptr_t)&FLASH->SR)
+    {
+        FLASH->SR = old->SR & ~FLASH->SR;
+        return;
+    }
+    if(addr == (uintptr_t)&FLASH->KEYR)
+    {
+        SimFlashKey = ((SimFlashKey == 0) && (FLASH->KEYR == FLASH_KEY1)) ? 1 :
+                      ((SimFlashKey == 1) && (FLASH->KEYR == FLASH_KEY2)) ? 2 : 0;
+        if(SimFlashKey == 2)
+        {
+            FLASH->CR = old->CR & ~FLASH_CR_LOCK;
+            SimFlashKey = 0;
+        }
+        return;
+    }
+    if((old->CR & FLASH_CR_LOCK) != 0)
+    {
+        /* Only LOCK can be written */
+        FLASH->CR = old->CR;
+        return;
+    }
+    if(((cr & FLASH_CR_STRT) != 0) && ((old->CR & FLASH_CR_STRT) == 0))
+    {
+        FLASH->CR = cr & ~FLASH_CR_STRT;
+        if((cr & FLASH_CR_PER) == 0)
+        {
+            return;
+        }
+        if(sim_flashFails())
+        {
+            sim_flashEvent(FLASH_SR_WRPRTERR);
+            return;
+        }
+        page = (FLASH->AR - FLASH_BASE) & ~(PAGE_SIZE - 1);
+        if(page < SIM_FLASH_SIZE)
+        {
+            /* PAGE_SIZE is within one host page */
+            mprotect((void *)((FLASH_BASE + page) & ~(SIM_PAGE - 1)), SIM_PAGE, PROT_READ | PROT_WRITE);
+            memset((void *)(uintptr_t)(FLASH_BASE + page), 0xFF, PAGE_SIZE);
+            mprotect((void *)((FLASH_BASE + page) & ~(SIM_PAGE - 1)), SIM_PAGE, PROT_READ);
+            SimFlashStat.erases++;
+        }
+        sim_flashEvent(FLASH_SR_EOP);
+    }
+}
+
+/* A store to the flash */
+static void sim_flashStore(void)
+{
+    volatile uint16_t *pNew = (volatile uint16_t *)SimTrap.addr;
+    const uint16_t *pOld = (const uint16_t *)SimTrap.old;
+    uint32_t i;
+
+    for(i = 0; i < SimTrap.size / 2; i++)
+    {
+        if(pNew[i] == pOld[i])
+        {
+            continue;
+        }
+        if(((FLASH->CR & (FLASH_CR_PG | FLASH_CR_LOCK)) != FLASH_CR_PG) || sim_flashFails() ||
+           ((pOld[i] != 0xFFFF) && (pNew[i] != 0x0000)))
+        {
+            pNew[i] = pOld[i];
+            SimFlashStat.errors++;
+            sim_flashEvent(FLASH_SR_PGERR);
+        }
+        else
+        {
+            SimFlashStat.programs++;
+            SimDwt.CYCCNT += SIM_PROGRAM_CYCLES;
+            sim_flashEvent(FLASH_SR_EOP);
+        }
+    }
+}
+
+static void sim_segv(int sig, siginfo_t *si, void *context)
+{
+    ucontext_t *uc = (ucontext_t *)context;
+    uintptr_t addr = (uintptr_t)si->si_addr;
+
+    (void)sig;
+    if((SimFlashProtected == 0) || (!sim_inFlash(addr) && !sim_inRegs(addr)))
+    {
+        /* A real fault */
+        signal(SIGSEGV, SIG_DFL);
+        return;
+    }
+    SimTrap.regs = *FLASH;
+    SimTrap.addr = sim_inFlash(addr) ? (addr & ~(uintptr_t)1) : addr;
+    SimTrap.size = SIM_TRAP_SIZE;
+    if(sim_inFlash(addr))
+    {
+        if(SimTrap.addr + SimTrap.size > FLASH_BASE + SIM_FLASH_SIZE)
+        {
+            SimTrap.size = FLASH_BASE + SIM_FLASH_SIZE - SimTrap.addr;
+        }
+        memcpy(SimTrap.old, (const void *)SimTrap.addr, SimTrap.size);
+    }
+    /* The flash is followed by a spare page, the registers are alone */
+    mprotect((void *)(addr & ~(SIM_PAGE - 1)), sim_inFlash(addr) ? SIM_PAGE * 2 : SIM_PAGE, PROT_READ | PROT_WRITE);
+    /* Step the store, sim_trap() judges it */
+    uc->uc_mcontext.gregs[REG_EFL] |= SIM_EFLAGS_TF;
+}
+
+static void sim_trap(int sig, siginfo_t *si, void *context)
+{
+    ucontext_t *uc = (ucontext_t *)context;
+
+    (void)sig;
+    (void)si;
+    uc->uc_mcontext.gregs[REG_EFL] &= ~SIM_EFLAGS_TF;
+    /* The controller itself writes the registers */
+    mprotect((void *)FLASH, SIM_PAGE, PROT_READ | PROT_WRITE);
+    if(sim_inRegs(SimTrap.addr))
+    {
+        sim_flashRegs(SimTrap.addr, &SimTrap.regs);
+    }
+    else
+    {
+        sim_flashStore();
+    }
+    mprotect((void *)(SimTrap.addr & ~(SIM_PAGE - 1)), sim_inFlash(SimTrap.addr) ? SIM_PAGE * 2 : SIM_PAGE, PROT_READ);
+    mprotect((void *)FLASH, SIM_PAGE, PROT_READ);
+}
+
+/**
+ ****************************************************************************
+ * @brief  Map the internal flash at FLASH_BASE, blank, and the FLASH
+ *         registers in a page of their own.
+ * @author lizdDong
+ * @note   Aborts the test if the address range is taken.
+ * @param  None
+ * @retval None
+ ****************************************************************************
+*/
+void sim_flashMap(void)
+{
+    struct sigaction sa;
+    void *p;
+
+    p = mmap((void *)(uintptr_t)FLASH_BASE, SIM_FLASH_SIZE + SIM_PAGE, PROT_READ | PROT_WRITE,
+             MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE, -1, 0);
+    if(p != (void *)(uintptr_t)FLASH_BASE)
+    {
+        fprintf(stderr, "sim: can not map the flash at 0x%08X\n", FLASH_BASE);
+        exit(2);
+    }
+    memset(p, 0xFF, SIM_FLASH_SIZE);
+    /* The page after the flash, the stepped store may reach it */
+    FLASH = (FLASH_TypeDef *)((uint8_t *)p + SIM_FLASH_SIZE + SIM_PAGE);
+    p = mmap((void *)FLASH, SIM_PAGE, PROT_READ | PROT_WRITE,
+             MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE, -1, 0);
+    if(p != (void *)FLASH)
+    {
+        fprintf(stderr, "sim: can not map the FLASH registers\n");
+        exit(2);
+    }
+    *FLASH = SimFlash;
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_flags = SA_SIGINFO | SA_NODEFER;
+    sa.sa_sigaction = sim_segv;
+    sigaction(SIGSEGV, &sa, 0);
+    sa.sa_sigaction = sim_trap;
+    sigaction(SIGTRAP, &sa, 0);
+}
+
+/**
+ ****************************************************************************
+ * @brief  Switch the simulated controller on or off.
+ * @author lizdDong
+ * @note   Off, the flash and the registers are plain memory the test can
+ *         set up as it likes.
+ * @param  on: 1 to trap the stores.
+ * @retval None
+ ****************************************************************************
+*/
+void sim_flashProtect(uint32_t on)
+{
+    int prot = (on != 0) ? PROT_READ : (PROT_READ | PROT_WRITE);
+
+    SimFlashProtected = on;
+    mprotect((void *)(uintptr_t)FLASH_BASE, SIM_FLASH_SIZE, prot);
+    mprotect((void *)FLASH, SIM_PAGE, prot);
+}
+
+/**
+ ****************************************************************************
+ * @brief  Serve the FLASH interrupt held by the controller.
+ * @author lizdDong
+ * @note   Nothing happens while the interrupt is disabled in the NVIC.
+ * @param  None
+ * @retval 1: FLASH_IRQHandler() was called
+ *         0: No interrupt
+ ****************************************************************************
+*/
+uint32_t sim_flashPoll(void)
+{
+    if((SimFlashIrq == 0) || (SimFlashIrqOn == 0) || (FLASH_IRQHandler == 0))
+    {
+        return 0;
+    }
+    SimFlashIrq = 0;
+    FLASH_IRQHandler();
+    return 1;
+}
+
+/**
+ ****************************************************************************
+ * @brief  Store one byte received by a circular DMA channel.
+ * @author lizdDong
+ * @note   Like the hardware, CNDTR counts down and is reloaded at 0.
+ * @param  ch: The channel set up by DMA_Init().
+ * @param  c: The byte.
+ * @retval None
+ ****************************************************************************
+*/
+void sim_dmaPut(DMA_Channel_TypeDef *ch, uint8_t c)
+{
+    uint32_t size = *sim_dmaSize(ch);
+
+    ((uint8_t *)(uintptr_t)ch->CMAR)[size - ch->CNDTR] = c;
+    if(--ch->CNDTR == 0)
+    {
+        ch->CNDTR = size;
+    }
+}
+
+static void *sim_tickThread(void *arg)
+{
+    (void)arg;
+    for(;;)
+    {
+        usleep(1000);
+        gMsCounter++;
+    }
+    return 0;
+}
+
+/**
+ ****************************************************************************
+ * @brief  Count gMsCounter in real time, as SysTick_Handler() does.
+ * @author lizdDong
+ * @note   None
+ * @param  None
+ * @retval None
+ ****************************************************************************
+*/
+void sim_tickStart(void)
+{
+    pthread_t thread;
+
+    pthread_create(&thread, 0, sim_tickThread, 0);
+    pthread_detach(thread);
+}
+
+void RCC_APB2PeriphClockCmd(uint32_t p, FunctionalState s) { (void)p; (void)s; }
+void RCC_APB1PeriphClockCmd(uint32_t p, FunctionalState s) { (void)p; (void)s; }
+void RCC_AHBPeriphClockCmd(uint32_t p, FunctionalState s) { (void)p; (void)s; }
+
+void GPIO_PinRemapConfig(uint32_t r, FunctionalState s) { (void)r; (void)s; }
+void GPIO_ResetBits(GPIO_TypeDef *g, uint16_t p) { g->BRR = p; }
+void GPIO_DeInit(GPIO_TypeDef *g) { memset((void *)g, 0, sizeof(*g)); }
+void GPIO_Init(GPIO_TypeDef *g, GPIO_InitTypeDef *i) { (void)g; (void)i; }
+
+void USART_Init(USART_TypeDef *u, USART_InitTypeDef *i) { (void)u; (void)i; }
+void USART_ClearFlag(USART_TypeDef *u, uint16_t f) { u->SR &= ~f; }
+void USART_Cmd(USART_TypeDef *u, FunctionalState s) { (void)u; (void)s; }
+void USART_DeInit(USART_TypeDef *u) { memset((void *)u, 0, sizeof(*u)); }
+void USART_DMACmd(USART_TypeDef *u, uint16_t r, FunctionalState s) { (void)u; (void)r; (void)s; }
+void USART_ITConfig(USART_TypeDef *u, uint16_t i, FunctionalState s) { (void)u; (void)i; (void)s; }
+ITStatus USART_GetITStatus(USART_TypeDef *u, uint16_t i) { (void)u; (void)i; return RESET; }
+uint16_t USART_ReceiveData(USART_TypeDef *u) { return u->DR; }
+
+/* The transmitter is always done */
+FlagStatus USART_GetFlagStatus(USART_TypeDef *u, uint16_t f)
+{
+    (void)u;
+    return ((f & (USART_FLAG_TC | USART_FLAG_TXE)) != 0) ? SET : RESET;
+}
+
+void USART_SendData(USART_TypeDef *u, uint16_t data)
+{
+    if(sim_usartTx != 0)
+    {
+        sim_usartTx(u, (uint8_t)data);
+    }
+}
+
+void DMA_DeInit(DMA_Channel_TypeDef *ch)
+{
+    memset((void *)ch, 0, sizeof(*ch));
+}
+
+void DMA_Init(DMA_Channel_TypeDef *ch, DMA_InitTypeDef *init)
+{
+    ch->CPAR = init->DMA_PeripheralBaseAddr;
+    ch->CMAR = init->DMA_MemoryBaseAddr;
+    ch->CNDTR = init->DMA_BufferSize;
+    ch->CCR = init->DMA_Mode | init->DMA_MemoryInc | init->DMA_Priority;
+    *sim_dmaSize(ch) = init->DMA_BufferSize;
+}
+
+void DMA_Cmd(DMA_Channel_TypeDef *ch, FunctionalState s)
+{
+    if(s != DISABLE)
+    {
+        ch->CCR |= DMA_CCR1_EN;
+    }
+    else
+    {
+        ch->CCR &= ~DMA_CCR1_EN;
+    }
+}
+
+uint16_t DMA_GetCurrDataCounter(DMA_Channel_TypeDef *ch)
+{
+    return (uint16_t)ch->CNDTR;
+}
+
+void NVIC_Init(NVIC_InitTypeDef *i) { (void)i; }
+void NVIC_EnableIRQ(IRQn_Type irq) { SimFlashIrqOn |= (irq == FLASH_IRQn); }
+void NVIC_DisableIRQ(IRQn_Type irq) { SimFlashIrqOn &= (irq != FLASH_IRQn); }
+void NVIC_ClearPendingIRQ(IRQn_Type irq) { (void)irq; }
+void NVIC_SetPriority(IRQn_Type irq, uint32_t p) { (void)irq; (void)p; }
+
+void FLASH_Unlock(void)
+{
+    FLASH->KEYR = FLASH_KEY1;
+    FLASH->KEYR = FLASH_KEY2;
+}
+
+void FLASH_Lock(void) { FLASH->CR |= FLASH_CR_LOCK; }
+void FLASH_ClearFlag(uint32_t f) { FLASH->SR = f; }
+void FLASH_ITConfig(uint32_t it, FunctionalState s) { (void)it; (void)s; }
+FLASH_Status FLASH_WaitForLastOperation(uint32_t t) { (void)t; return FLASH_GetStatus(); }
+
+FLASH_Status FLASH_GetStatus(void)
+{
+    if((FLASH->SR & FLASH_SR_PGERR) != 0)
+    {
+        return FLASH_ERROR_PG;
+    }
+    return ((FLASH->SR & FLASH_SR_WRPRTERR) != 0) ? FLASH_ERROR_WRP : FLASH_COMPLETE;
+}
+
+FLASH_Status FLASH_ErasePage(uint32_t addr)
+{
+    FLASH->CR |= FLASH_CR_PER;
+    FLASH->AR = addr;
+    FLASH->CR |= FLASH_CR_STRT;
+    FLASH->CR &= ~FLASH_CR_PER;
+    return FLASH_GetStatus();
+}
+
+FLASH_Status FLASH_ProgramHalfWord(uint32_t addr, uint16_t data)
+{
+    FLASH->CR |= FLASH_CR_PG;
+    *(volatile uint16_t *)(uintptr_t)addr = data;
+    FLASH->CR &= ~FLASH_CR_PG;
+    return FLASH_GetStatus();
+}
+
+uint32_t SysTick_Config(uint32_t ticks) { (void)ticks; return 0; }
+void __set_MSP(uint32_t sp) { (void)sp; }
+void __set_PRIMASK(uint32_t m) { (void)m; }
+uint32_t __get_PRIMASK(void) { return 0; }
+void __disable_irq(void) {}
+void __enable_irq(void) {}
+void __DSB(void) {}
+void __ISB(void) {}
+void __NOP(void) {}
+void __WFI(void) {}
+
+
+/****************************** End of file ***********************************/
@@ -0,0 +1,48 @@
+/**
+  ******************************************************************************
+  * @file    test.h
+  * @author  lizdDong
+  * @version V1.0
+  * @date    2026-10-17
+  * @brief   Checks of the host unit tests, a test returns TEST_RESULT() from
+  *          main().
+  * @attention
+  *
+  ******************************************************************************
+  */
+
+#ifndef _TEST_H_
+#define _TEST_H_
+
+#include <stdio.h>
+#include <stdint.h>
+
+
+static uint32_t TestFailures;
+
+#define CHECK(cond) \
+    do \
+    { \
+        if(!(cond)) \
+        { \
+            printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+            TestFailures++; \
+        } \
+    } \
+    while(0)
+
+#define TEST_RESULT()   ((TestFailures == 0) ? 0 : 1)
+
+/* Small and repeatable pseudo random numbers */
+static uint32_t TestSeed = 12345;
+
+static inline uint32_t test_rand(void)
+{
+    TestSeed = TestSeed * 1103515245u + 12345u;
+    return TestSeed >> 8;
+}
+
+
+#endif
+
+/****************************** End of file ***********************************/
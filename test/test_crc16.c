@@ -0,0 +1,140 @@
+/**
+ ******************************************************************************
+ * @file    test_crc16.c
+ * @author  lizdDong
+ * @version V1.0
+ * @date    2026-10-17
+ * @brief   The CRC16_METHOD kernel of crc16.c against the bit loop the ST
+ *          Ymodem used (UpdateCRC16() and two zero bytes), then its speed.
+ *          Built once per kernel, see CMakeLists.txt.
+ * @attention
+ *
+ ******************************************************************************
+ */
+
+#include <string.h>
+#include <time.h>
+#include "iap_cfg.h"
+#include "crc16.h"
+#include "test.h"
+
+
+#define BENCH_SIZE           (1024 * 1024)
+#define BENCH_LOOPS          (16)
+
+static uint8_t Data[BENCH_SIZE];
+
+/* UpdateCRC16() of the original ymodem.c */
+static uint16_t ref_update(uint16_t crcIn, uint8_t byte)
+{
+    uint32_t crc = crcIn;
+    uint32_t in = byte | 0x100;
+
+    do
+    {
+        crc <<= 1;
+        in <<= 1;
+        if(in & 0x100)
+            ++crc;
+        if(crc & 0x10000)
+            crc ^= 0x1021;
+    }
+    while(!(in & 0x10000));
+    return crc & 0xffffu;
+}
+
+/* Cal_CRC16() of the original ymodem.c */
+static uint16_t ref_calc(const uint8_t *data, uint32_t size)
+{
+    uint32_t crc = 0;
+    const uint8_t *dataEnd = data + size;
+
+    while(data < dataEnd)
+        crc = ref_update(crc, *data++);
+
+    crc = ref_update(crc, 0);
+    crc = ref_update(crc, 0);
+    return crc & 0xffffu;
+}
+
+static double test_seconds(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void test_equivalence(void)
+{
+    static const uint8_t check[] = "123456789";
+    uint32_t size, offset, i;
+    uint16_t crc;
+
+    CHECK(crc16_calc(0, check, 9) == 0x31C3);
+    CHECK(crc16_calc(0, check, 0) == 0);
+
+    for(size = 0; size <= 2100; size += 1 + size / 16)
+    {
+        for(offset = 0; offset < 4; offset++)
+        {
+            crc = crc16_calc(0, Data + offset, size);
+            CHECK(crc == ref_calc(Data + offset, size));
+
+            /* Byte by byte as Receive_Packet() does */
+            for(i = 0, crc = 0; i < size; i++)
+            {
+                crc = crc16_update(crc, Data[offset + i]);
+            }
+            CHECK(crc == ref_calc(Data + offset, size));
+
+            /* Split in two calls */
+            crc = crc16_calc(crc16_calc(0, Data + offset, size / 3), Data + offset + size / 3, size - size / 3);
+            CHECK(crc == ref_calc(Data + offset, size));
+
+            /* The trailer, high byte first, leaves a zero remainder */
+            crc = crc16_update(crc16_update(crc, (uint8_t)(crc >> 8)), (uint8_t)crc);
+            CHECK(crc == 0);
+        }
+    }
+}
+
+static void test_bench(void)
+{
+    volatile uint16_t sink = 0;
+    double t0, t1, t2;
+    uint32_t i;
+
+    t0 = test_seconds();
+    for(i = 0; i < BENCH_LOOPS; i++)
+    {
+        sink ^= crc16_calc(0, Data, BENCH_SIZE);
+    }
+    t1 = test_seconds();
+    for(i = 0; i < BENCH_LOOPS / 4; i++)
+    {
+        sink ^= ref_calc(Data, BENCH_SIZE);
+    }
+    t2 = test_seconds();
+    (void)sink;
+
+    printf("CRC16_METHOD %d: %.2f ns/byte, reference bit loop %.2f ns/byte\n", CRC16_METHOD,
+           (t1 - t0) * 1e9 / ((double)BENCH_SIZE * BENCH_LOOPS),
+           (t2 - t1) * 1e9 / ((double)BENCH_SIZE * (BENCH_LOOPS / 4)));
+}
+
+int main(void)
+{
+    uint32_t i;
+
+    for(i = 0; i < BENCH_SIZE; i++)
+    {
+        Data[i] = (uint8_t)test_rand();
+    }
+    test_equivalence();
+    test_bench();
+    return TEST_RESULT();
+}
+
+
+/****************************** End of file ***********************************/
@@ -0,0 +1,260 @@
+/**
+ ******************************************************************************
+ * @file    test_flash_async.c
+ * @author  lizdDong
+ * @version V1.0
+ * @date    2026-10-17
+ * @brief   The interrupt driven erase/program state machine of dev_flash.c
+ *          and the steps of dev_flashWriteStep() against the simulated
+ *          FLASH controller of stm32f10x_sim.c: the stores to the flash and
+ *          its registers are judged like the hardware would, the interrupt
+ *          of each operation is served by sim_flashPoll().
+ * @attention
+ *
+ ******************************************************************************
+ */
+
+#include <pthread.h>
+#include <string.h>
+#include "stm32f10x.h"
+#include "dev_flash.h"
+#include "sim.h"
+#include "test.h"
+
+
+#define AREA                 (IAP_IMAGE_ADDR)
+
+static int32_t CallbackStatus;
+static uint32_t CallbackCount;
+
+static void test_callback(int32_t status)
+{
+    CallbackStatus = status;
+    CallbackCount++;
+}
+
+/* Set the flash up with the controller off */
+static void test_fill(uint32_t addr, uint8_t value, uint32_t size)
+{
+    sim_flashProtect(0);
+    memset((void *)(uintptr_t)addr, value, size);
+    sim_flashProtect(1);
+    memset(&SimFlashStat, 0, sizeof(SimFlashStat));
+    CallbackCount = 0;
+    CallbackStatus = FLASH_ASYNC_BUSY;
+}
+
+static void test_blocking(void)
+{
+    static const uint16_t data[4] = {0x1234, 0x0000, 0xFFFF, 0x5678};
+
+    test_fill(AREA, 0xFF, PAGE_SIZE);
+    /* Unlocked for the call only */
+    CHECK(dev_flashProgram(AREA, (const uint8_t *)data, sizeof(data)) == 0);
+    CHECK((FLASH->CR & FLASH_CR_LOCK) != 0);
+    CHECK(memcmp((const void *)(uintptr_t)AREA, data, sizeof(data)) == 0);
+    CHECK(SimFlashStat.programs == 3);
+    /* Same data: nothing programmed, a half word not blank: PGERR */
+    CHECK(dev_flashProgram(AREA, (const uint8_t *)data, sizeof(data)) == 0);
+    CHECK(SimFlashStat.programs == 3);
+    CHECK(dev_flashProgram(AREA + 2, (const uint8_t *)data, 2) == -1);
+    CHECK(*(const uint16_t *)(uintptr_t)(AREA + 2) == 0x0000);
+    CHECK(dev_flashCompare(AREA, (const uint8_t *)data, sizeof(data)) == FLASH_CMP_SAME);
+
+    CHECK(dev_flashErasePage(AREA + 6) == 0);
+    CHECK(dev_flashIsBlank(AREA, PAGE_SIZE) == 1);
+    CHECK(SimFlashStat.erases == 1);
+    CHECK((FLASH->CR & FLASH_CR_LOCK) != 0);
+
+    /* The profile counts the bytes programmed, not the skipped ones:
+       only the half words take simulated cycles */
+    dev_flashProfileReset();
+    CHECK(dev_flashProgram(AREA, (const uint8_t *)data, sizeof(data)) == 0);
+    CHECK(dev_flashProgram(AREA, (const uint8_t *)data, sizeof(data)) == 0);
+    CHECK(dev_flashCyclesPerKB() == 3780 * 1024 / 2);
+}
+
+static void test_erase(void)
+{
+    test_fill(AREA, 0x12, PAGE_SIZE);
+    CHECK(dev_flashEraseAsync(AREA + 10, test_callback) == 0);
+    CHECK(dev_flashAsyncStatus() == FLASH_ASYNC_BUSY);
+    /* One operation at a time */
+    CHECK(dev_flashEraseAsync(AREA, 0) == -1);
+    CHECK(dev_flashProgramAsync(AREA, (const uint8_t *)AREA, 2, 0) == -1);
+    CHECK(CallbackCount == 0);
+
+    CHECK(sim_flashPoll() == 1);
+    CHECK(dev_flashAsyncStatus() == FLASH_ASYNC_DONE);
+    CHECK((CallbackCount == 1) && (CallbackStatus == FLASH_ASYNC_DONE));
+    CHECK(dev_flashIsBlank(AREA, PAGE_SIZE) == 1);
+    CHECK(SimFlashStat.erases == 1);
+    CHECK((FLASH->CR & (FLASH_CR_PER | FLASH_CR_EOPIE | FLASH_CR_ERRIE | FLASH_CR_LOCK)) == FLASH_CR_LOCK);
+    /* The interrupt is off once done */
+    CHECK(sim_flashPoll() == 0);
+}
+
+static void test_program(void)
+{
+    static uint16_t data[200];
+    uint32_t i, differ = 0, steps = 0;
+
+    test_fill(AREA, 0xFF, PAGE_SIZE);
+    sim_flashProtect(0);
+    /* Half of the range holds the data already */
+    for(i = 0; i < 200; i++)
+    {
+        data[i] = (uint16_t)(i * 0x0101 + 1);
+        if((i % 2) == 0)
+        {
+            ((uint16_t *)(uintptr_t)AREA)[i] = data[i];
+        }
+        else
+        {
+            differ++;
+        }
+    }
+    sim_flashProtect(1);
+
+    CHECK(dev_flashProgramAsync(AREA, (const uint8_t *)data, sizeof(data), test_callback) == 0);
+    do
+    {
+        /* One half word per interrupt */
+        CHECK(SimFlashStat.programs == ++steps);
+        CHECK(CallbackCount == 0);
+    }
+    while((sim_flashPoll() != 0) && (dev_flashAsyncStatus() == FLASH_ASYNC_BUSY));
+    CHECK(SimFlashStat.programs == differ);
+    CHECK(dev_flashAsyncStatus() == FLASH_ASYNC_DONE);
+    CHECK((CallbackCount == 1) && (CallbackStatus == FLASH_ASYNC_DONE));
+    CHECK(memcmp((const void *)(uintptr_t)AREA, data, sizeof(data)) == 0);
+    CHECK((FLASH->CR & (FLASH_CR_PG | FLASH_CR_EOPIE | FLASH_CR_ERRIE | FLASH_CR_LOCK)) == FLASH_CR_LOCK);
+
+    /* Nothing to program, done at once */
+    CallbackCount = 0;
+    CHECK(dev_flashProgramAsync(AREA, (const uint8_t *)data, sizeof(data), test_callback) == 0);
+    CHECK(dev_flashAsyncStatus() == FLASH_ASYNC_DONE);
+    CHECK((CallbackCount == 1) && (CallbackStatus == FLASH_ASYNC_DONE));
+    CHECK(sim_flashPoll() == 0);
+}
+
+static void test_error(void)
+{
+    static uint16_t data[16];
+    uint32_t i;
+
+    for(i = 0; i < 16; i++)
+    {
+        data[i] = (uint16_t)i + 1;
+    }
+    test_fill(AREA, 0xFF, PAGE_SIZE);
+    SimFlashStat.fail_at = 3;
+    CHECK(dev_flashProgramAsync(AREA, (const uint8_t *)data, sizeof(data), test_callback) == 0);
+    while(sim_flashPoll() != 0);
+    CHECK((SimFlashStat.programs == 2) && (SimFlashStat.errors == 1));
+    CHECK(dev_flashAsyncStatus() == FLASH_ASYNC_ERROR);
+    CHECK((CallbackCount == 1) && (CallbackStatus == FLASH_ASYNC_ERROR));
+    CHECK(((const uint16_t *)(uintptr_t)AREA)[2] == 0xFFFF);
+
+    /* A new operation can start after an error */
+    CHECK(dev_flashEraseAsync(AREA, 0) == 0);
+    CHECK(sim_flashPoll() == 1);
+    CHECK(dev_flashAsyncStatus() == FLASH_ASYNC_DONE);
+}
+
+static volatile uint32_t PollStop;
+
+static void *test_pollThread(void *arg)
+{
+    (void)arg;
+    while(PollStop == 0)
+    {
+        sim_flashPoll();
+    }
+    return 0;
+}
+
+static void test_wait(void)
+{
+    pthread_t thread;
+
+    test_fill(AREA, 0x00, PAGE_SIZE);
+    CHECK(dev_flashEraseAsync(AREA, 0) == 0);
+    PollStop = 0;
+    pthread_create(&thread, 0, test_pollThread, 0);
+    CHECK(dev_flashAsyncWait() == FLASH_ASYNC_DONE);
+    PollStop = 1;
+    pthread_join(thread, 0);
+    CHECK(dev_flashIsBlank(AREA, PAGE_SIZE) == 1);
+}
+
+static void test_write_steps(void)
+{
+    static uint8_t data[PAGE_SIZE + 200];
+    uint32_t i, steps = 0, unlocks = 0, locked;
+    int32_t status;
+
+    for(i = 0; i < sizeof(data); i++)
+    {
+        data[i] = (uint8_t)(i * 3);
+    }
+    /* Not blank: both pages are erased by the steps */
+    test_fill(AREA, 0x00, PAGE_SIZE * 2);
+    dev_flashSync();
+    CHECK(dev_flashWriteStart(AREA + 100, data, sizeof(data)) == 0);
+    CHECK(dev_flashWriteStart(AREA, data, 2) == -1);
+    locked = 1;
+    while((status = dev_flashWriteStep()) == FLASH_ASYNC_BUSY)
+    {
+        sim_flashPoll();
+        steps++;
+        /* Unlocked once for the whole job */
+        if((locked != 0) && ((FLASH->CR & FLASH_CR_LOCK) == 0))
+        {
+            unlocks++;
+        }
+        locked = ((FLASH->CR & FLASH_CR_LOCK) != 0);
+    }
+    CHECK(status == FLASH_ASYNC_DONE);
+    CHECK(unlocks == 1);
+    CHECK((SimFlashStat.erases == 2) && (SimFlashStat.errors == 0));
+    CHECK(steps >= PAGE_SIZE * 2 / 2 / FLASH_WRITE_STEP);
+    CHECK(memcmp((const void *)(uintptr_t)(AREA + 100), data, sizeof(data)) == 0);
+    CHECK(*(const uint8_t *)(uintptr_t)(AREA + 99) == 0x00);
+    CHECK((FLASH->CR & FLASH_CR_LOCK) != 0);
+
+    /* An erase error ends the write */
+    test_fill(AREA, 0x00, PAGE_SIZE * 2);
+    dev_flashSync();
+    SimFlashStat.fail_at = 1;
+    CHECK(dev_flashWriteStart(AREA, data, PAGE_SIZE) == 0);
+    while((status = dev_flashWriteStep()) == FLASH_ASYNC_BUSY)
+    {
+        sim_flashPoll();
+    }
+    CHECK(status == FLASH_ASYNC_ERROR);
+    CHECK((FLASH->CR & FLASH_CR_LOCK) != 0);
+    /* and the page is written again by the next one */
+    CHECK(dev_flashWriteStart(AREA, data, PAGE_SIZE) == 0);
+    while((status = dev_flashWriteStep()) == FLASH_ASYNC_BUSY)
+    {
+        sim_flashPoll();
+    }
+    CHECK(status == FLASH_ASYNC_DONE);
+    CHECK(memcmp((const void *)(uintptr_t)AREA, data, PAGE_SIZE) == 0);
+}
+
+int main(void)
+{
+    sim_flashMap();
+    test_blocking();
+    test_erase();
+    test_program();
+    test_error();
+    test_wait();
+    test_write_steps();
+    return TEST_RESULT();
+}
+
+
+/****************************** End of file ***********************************/
@@ -0,0 +1,131 @@
+/**
+ ******************************************************************************
+ * @file    test_flash_backend.c
+ * @author  lizdDong
+ * @version V1.0
+ * @date    2026-10-17
+ * @brief   All the dev_flash functions go through the selected backend: with
+ *          dev_flashSim selected the simulated internal flash must not see
+ *          a single erase or program.
+ * @attention
+ *
+ ******************************************************************************
+ */
+
+#include <string.h>
+#include "stm32f10x.h"
+#include "dev_flash.h"
+#include "dev_flash_sim.h"
+#include "sim.h"
+#include "test.h"
+
+
+#define AREA                 (FLASH_SIM_BASE)
+
+static uint32_t CallbackCount;
+static int32_t CallbackStatus;
+
+static void test_callback(int32_t status)
+{
+    CallbackStatus = status;
+    CallbackCount++;
+}
+
+static void test_blocking(void)
+{
+    static const uint16_t data[4] = {0x1234, 0x0000, 0xFFFF, 0x5678};
+    uint16_t back[4];
+
+    dev_flashSimFill(0xFF);
+    CHECK(dev_flashIsBlank(AREA, PAGE_SIZE * FLASH_SIM_PAGES) == 1);
+    CHECK(dev_flashCompare(AREA, (const uint8_t *)data, sizeof(data)) == FLASH_CMP_WRITE);
+    CHECK(dev_flashProgram(AREA, (const uint8_t *)data, sizeof(data)) == 0);
+    CHECK(dev_flashSimStat.programs == 3);
+    CHECK(dev_flashCompare(AREA, (const uint8_t *)data, sizeof(data)) == FLASH_CMP_SAME);
+    CHECK(dev_flashRead(AREA, (uint8_t *)back, sizeof(back)) == sizeof(back));
+    CHECK(memcmp(back, data, sizeof(data)) == 0);
+    /* Not blank: refused */
+    CHECK(dev_flashCompare(AREA + 2, (const uint8_t *)data, 2) == FLASH_CMP_ERASE);
+    CHECK(dev_flashProgram(AREA + 2, (const uint8_t *)data, 2) == -1);
+    CHECK(dev_flashSimStat.errors == 1);
+
+    CHECK(dev_flashErasePage(AREA + 6) == 0);
+    CHECK(dev_flashIsBlank(AREA, PAGE_SIZE) == 1);
+    CHECK((dev_flashSimStat.erases == 1) && (dev_flashSimStat.wear[0] == 1));
+    CHECK(dev_flashSimStat.busy_us == FLASH_SIM_ERASE_US + 3 * FLASH_SIM_PROGRAM_US);
+    /* Out of the backend */
+    CHECK(dev_flashErasePage(AREA + PAGE_SIZE * FLASH_SIM_PAGES) == -1);
+}
+
+static void test_async(void)
+{
+    static const uint16_t data[4] = {1, 2, 3, 4};
+
+    dev_flashSimFill(0x00);
+    /* No asynchronous operation: done at once */
+    CHECK(dev_flashEraseAsync(AREA + PAGE_SIZE, test_callback) == 0);
+    CHECK(dev_flashAsyncStatus() == FLASH_ASYNC_DONE);
+    CHECK((CallbackCount == 1) && (CallbackStatus == FLASH_ASYNC_DONE));
+    CHECK(dev_flashIsBlank(AREA + PAGE_SIZE, PAGE_SIZE) == 1);
+    CHECK(dev_flashProgramAsync(AREA + PAGE_SIZE, (const uint8_t *)data, sizeof(data), test_callback) == 0);
+    CHECK(dev_flashAsyncWait() == FLASH_ASYNC_DONE);
+    CHECK(dev_flashProgramAsync(AREA, (const uint8_t *)data, sizeof(data), test_callback) == 0);
+    CHECK((CallbackCount == 3) && (CallbackStatus == FLASH_ASYNC_ERROR));
+    CHECK(dev_flashCompare(AREA + PAGE_SIZE, (const uint8_t *)data, sizeof(data)) == FLASH_CMP_SAME);
+    /* Refused by the backend: ended with an error, not left busy */
+    CHECK(dev_flashEraseAsync(AREA + PAGE_SIZE * FLASH_SIM_PAGES, 0) == 0);
+    CHECK(dev_flashAsyncWait() == FLASH_ASYNC_ERROR);
+    CHECK(dev_flashEraseAsync(AREA, test_callback) == 0);
+    CHECK((CallbackCount == 4) && (CallbackStatus == FLASH_ASYNC_DONE));
+    CHECK(dev_flashIsBlank(AREA, PAGE_SIZE) == 1);
+}
+
+static void test_write(void)
+{
+    static uint8_t data[PAGE_SIZE + 300];
+    uint32_t i;
+    int32_t status;
+
+    for(i = 0; i < sizeof(data); i++)
+    {
+        data[i] = (uint8_t)(i * 7);
+    }
+    dev_flashSimFill(0x00);
+    CHECK(dev_flashEraseRange(AREA, PAGE_SIZE * FLASH_SIM_PAGES, 0) == 0);
+    CHECK(dev_flashSimStat.erases == FLASH_SIM_PAGES);
+    /* Blank already: skipped */
+    CHECK(dev_flashEraseRange(AREA, PAGE_SIZE * FLASH_SIM_PAGES, 0) == 0);
+    CHECK(dev_flashSimStat.erases == FLASH_SIM_PAGES);
+
+    CHECK(dev_flashWrite(AREA + 100, data, sizeof(data)) == sizeof(data));
+    CHECK(dev_flashSync() == 0);
+    CHECK(dev_flashCompare(AREA + 100, data, sizeof(data)) == FLASH_CMP_SAME);
+    CHECK(dev_flashSimStat.erases == FLASH_SIM_PAGES);
+
+    /* Over the data: the pages are erased by the steps */
+    data[0] ^= 0xFF;
+    CHECK(dev_flashWriteStart(AREA + 100, data, sizeof(data)) == 0);
+    while((status = dev_flashWriteStep()) == FLASH_ASYNC_BUSY);
+    CHECK(status == FLASH_ASYNC_DONE);
+    CHECK(dev_flashCompare(AREA + 100, data, sizeof(data)) == FLASH_CMP_SAME);
+    CHECK(dev_flashSimStat.wear[0] == 2);
+}
+
+int main(void)
+{
+    sim_flashMap();
+    sim_flashProtect(1);
+    CHECK(dev_flashSetBackend(&dev_flashSim) == 0);
+
+    test_blocking();
+    test_async();
+    test_write();
+
+    /* The internal flash was never touched */
+    CHECK((SimFlashStat.erases == 0) && (SimFlashStat.programs == 0) && (SimFlashStat.errors == 0));
+    CHECK(dev_flashSetBackend(&dev_flashInternal) == 0);
+    return TEST_RESULT();
+}
+
+
+/****************************** End of file ***********************************/
@@ -0,0 +1,124 @@
+/**
+ ******************************************************************************
+ * @file    test_flash_cache.c
+ * @author  lizdDong
+ * @version V1.0
+ * @date    2026-10-17
+ * @brief   The write-back cache of dev_flashWrite() on the dev_flashSim
+ *          backend: the content must match a shadow copy after random
+ *          small writes, and the erases are counted. Built once with the
+ *          cache and once write through (FLASH_CACHE_PAGES 0) to compare.
+ * @attention
+ *
+ ******************************************************************************
+ */
+
+#include <string.h>
+#include "stm32f10x.h"
+#include "dev_flash.h"
+#include "dev_flash_sim.h"
+#include "test.h"
+
+
+#define AREA                 (FLASH_SIM_BASE)
+#define AREA_SIZE            (PAGE_SIZE * FLASH_SIM_PAGES)
+#define RECORD_SIZE          (PAGE_SIZE * 2)
+
+static uint8_t Shadow[AREA_SIZE];
+static uint8_t Back[AREA_SIZE];
+
+static void test_check(void)
+{
+    CHECK(dev_flashRead(AREA, Back, AREA_SIZE) == AREA_SIZE);
+    CHECK(memcmp(Back, Shadow, AREA_SIZE) == 0);
+}
+
+/* A 2 byte flag rewritten over and over, as main() did */
+static uint32_t test_flag(void)
+{
+    uint16_t flag;
+    uint32_t i;
+
+    dev_flashSimFill(0xFF);
+    memset(Shadow, 0xFF, AREA_SIZE);
+    for(i = 0; i < 100; i++)
+    {
+        flag = (uint16_t)(0xA55A ^ i);
+        CHECK(dev_flashWrite(AREA, (const uint8_t *)&flag, 2) == 2);
+        memcpy(Shadow, &flag, 2);
+    }
+    CHECK(dev_flashSync() == 0);
+    test_check();
+    return dev_flashSimStat.erases;
+}
+
+/* Small records written at random places of two pages, flushed four
+   times */
+static uint32_t test_records(void)
+{
+    uint8_t record[32];
+    uint32_t i, j, addr, size;
+
+    dev_flashSimFill(0xFF);
+    memset(Shadow, 0xFF, AREA_SIZE);
+    for(i = 0; i < 400; i++)
+    {
+        size = (test_rand() % 16 + 1) * 2;
+        addr = (test_rand() % ((RECORD_SIZE - size) / 2)) * 2;
+        for(j = 0; j < size; j++)
+        {
+            record[j] = (uint8_t)test_rand();
+        }
+        CHECK(dev_flashWrite(AREA + addr, record, size) == size);
+        memcpy(Shadow + addr, record, size);
+        if((i % 100) == 99)
+        {
+            CHECK(dev_flashFlush() == 0);
+            test_check();
+        }
+    }
+    CHECK(dev_flashSync() == 0);
+    test_check();
+    return dev_flashSimStat.erases;
+}
+
+/* One large write in order, no page is erased twice either way */
+static uint32_t test_sequential(void)
+{
+    uint32_t i;
+
+    dev_flashSimFill(0x00);
+    for(i = 0; i < AREA_SIZE; i++)
+    {
+        Shadow[i] = (uint8_t)(i * 13);
+    }
+    for(i = 0; i < AREA_SIZE; i += 128)
+    {
+        CHECK(dev_flashWrite(AREA + i, Shadow + i, 128) == 128);
+    }
+    CHECK(dev_flashSync() == 0);
+    test_check();
+    CHECK(dev_flashSimStat.erases <= FLASH_SIM_PAGES * ((FLASH_CACHE_PAGES != 0) ? 1 : PAGE_SIZE / 128));
+    return dev_flashSimStat.erases;
+}
+
+int main(void)
+{
+    uint32_t flag, records, sequential;
+
+    CHECK(dev_flashSetBackend(&dev_flashSim) == 0);
+    flag = test_flag();
+    records = test_records();
+    sequential = test_sequential();
+#if (FLASH_CACHE_PAGES)
+    /* Each page is erased once per sync at the most */
+    CHECK(flag <= 1);
+    CHECK(records <= 2 * 5);
+#endif
+    printf("FLASH_CACHE_PAGES %d: erases flag %u, records %u, sequential %u\n",
+           FLASH_CACHE_PAGES, flag, records, sequential);
+    return TEST_RESULT();
+}
+
+
+/****************************** End of file ***********************************/
@@ -0,0 +1,210 @@
+/**
+ ******************************************************************************
+ * @file    test_flash_read.c
+ * @author  lizdDong
+ * @version V1.0
+ * @date    2026-10-17
+ * @brief   The word-wide dev_flashRead(), dev_flashCompare() and
+ *          dev_flashIsBlank() of the internal flash against byte loops, at
+ *          every alignment of both sides, then their speed.
+ * @attention
+ *
+ ******************************************************************************
+ */
+
+#include <string.h>
+#include <time.h>
+#include "stm32f10x.h"
+#include "dev_flash.h"
+#include "sim.h"
+#include "test.h"
+
+
+#define AREA                 (IAP_IMAGE_ADDR)
+#define AREA_SIZE            (PAGE_SIZE * 4)
+#define BENCH_LOOPS          (2000)
+
+static uint8_t Buff[AREA_SIZE + 8] __attribute__((aligned(4)));
+
+static uint32_t ref_compare(uint32_t addr, const uint8_t *pBuff, uint32_t size)
+{
+    const uint8_t *pFlash = (const uint8_t *)(uintptr_t)addr;
+    uint32_t i, result = FLASH_CMP_SAME;
+    uint16_t f, d;
+
+    for(i = 0; i + 1 < size; i += 2)
+    {
+        f = pFlash[i] | (pFlash[i + 1] << 8);
+        d = pBuff[i] | (pBuff[i + 1] << 8);
+        if(f == d)
+        {
+            continue;
+        }
+        if(f != 0xFFFF)
+        {
+            return FLASH_CMP_ERASE;
+        }
+        result = FLASH_CMP_WRITE;
+    }
+    return result;
+}
+
+static uint32_t ref_blank(uint32_t addr, uint32_t size)
+{
+    const uint8_t *pFlash = (const uint8_t *)(uintptr_t)addr;
+    uint32_t i;
+
+    for(i = 0; i < size; i++)
+    {
+        if(pFlash[i] != 0xFF)
+        {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static double test_seconds(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void test_read(void)
+{
+    uint32_t src, dst, size;
+
+    for(src = 0; src < 4; src++)
+    {
+        for(dst = 0; dst < 4; dst++)
+        {
+            for(size = 0; size < 80; size++)
+            {
+                memset(Buff, 0xCC, sizeof(Buff));
+                CHECK(dev_flashRead(AREA + src, Buff + dst, size) == size);
+                CHECK(memcmp(Buff + dst, (const void *)(uintptr_t)(AREA + src), size) == 0);
+                CHECK((dst == 0) || (Buff[dst - 1] == 0xCC));
+                CHECK(Buff[dst + size] == 0xCC);
+            }
+        }
+    }
+    /* Clipped at the end of the flash */
+    CHECK(dev_flashRead(FLASH_BASE + FLASH_SIZE - 6, Buff, 16) == 6);
+    CHECK(dev_flashRead(FLASH_BASE + FLASH_SIZE, Buff, 16) == 0);
+}
+
+static void test_compare(void)
+{
+    uint32_t addr, buf, size, i, n, hits[3] = {0, 0, 0};
+
+    for(n = 0; n < 3000; n++)
+    {
+        /* Data, blank or mixed page */
+        addr = AREA + (test_rand() % 3) * PAGE_SIZE + (test_rand() % 64) * 2;
+        buf = (test_rand() % 2) * 2;
+        size = (test_rand() % 200) * 2;
+        memcpy(Buff + buf, (const void *)(uintptr_t)addr, size);
+        /* A few half words changed: to 0xFFFF, from 0xFFFF, or anything */
+        for(i = test_rand() % 3; (i != 0) && (size != 0); i--)
+        {
+            uint32_t k = (test_rand() % (size / 2)) * 2;
+
+            switch(test_rand() % 3)
+            {
+                case 0:
+                    Buff[buf + k] = 0xFF;
+                    Buff[buf + k + 1] = 0xFF;
+                    break;
+                case 1:
+                    Buff[buf + k] = (uint8_t)test_rand();
+                    break;
+                default:
+                    Buff[buf + k + 1] ^= 0x01;
+                    break;
+            }
+        }
+        CHECK(dev_flashCompare(addr, Buff + buf, size) == ref_compare(addr, Buff + buf, size));
+        hits[ref_compare(addr, Buff + buf, size)]++;
+    }
+    /* All the results were seen */
+    CHECK((hits[FLASH_CMP_SAME] != 0) && (hits[FLASH_CMP_WRITE] != 0) && (hits[FLASH_CMP_ERASE] != 0));
+}
+
+static void test_blank(void)
+{
+    uint8_t *pFlash = (uint8_t *)(uintptr_t)(AREA + PAGE_SIZE);
+    uint32_t start, size, k;
+
+    for(start = 0; start < 8; start++)
+    {
+        for(size = 0; size < 72; size++)
+        {
+            CHECK(dev_flashIsBlank(AREA + PAGE_SIZE + start, size) == 1);
+            for(k = 0; k < size; k++)
+            {
+                pFlash[start + k] = 0x7F;
+                CHECK(dev_flashIsBlank(AREA + PAGE_SIZE + start, size) == 0);
+                pFlash[start + k] = 0xFF;
+            }
+        }
+    }
+    CHECK(dev_flashIsBlank(AREA + PAGE_SIZE, PAGE_SIZE) == ref_blank(AREA + PAGE_SIZE, PAGE_SIZE));
+}
+
+static void test_bench(void)
+{
+    volatile uint32_t sink = 0;
+    double t0, t1, t2, t3;
+    uint32_t i;
+
+    dev_flashRead(AREA, Buff, PAGE_SIZE);
+    t0 = test_seconds();
+    for(i = 0; i < BENCH_LOOPS; i++)
+    {
+        dev_flashRead(AREA, Buff, PAGE_SIZE);
+    }
+    t1 = test_seconds();
+    for(i = 0; i < BENCH_LOOPS; i++)
+    {
+        sink += dev_flashCompare(AREA, Buff, PAGE_SIZE);
+    }
+    t2 = test_seconds();
+    for(i = 0; i < BENCH_LOOPS; i++)
+    {
+        sink += ref_compare(AREA, Buff, PAGE_SIZE);
+    }
+    t3 = test_seconds();
+    (void)sink;
+
+    printf("Page read %.0f ns, compare %.0f ns, byte loop compare %.0f ns\n",
+           (t1 - t0) * 1e9 / BENCH_LOOPS, (t2 - t1) * 1e9 / BENCH_LOOPS, (t3 - t2) * 1e9 / BENCH_LOOPS);
+}
+
+int main(void)
+{
+    uint8_t *pFlash;
+    uint32_t i;
+
+    sim_flashMap();
+    /* Data in the first page, the second one stays blank */
+    pFlash = (uint8_t *)(uintptr_t)AREA;
+    for(i = 0; i < PAGE_SIZE; i++)
+    {
+        pFlash[i] = (uint8_t)test_rand();
+    }
+    for(i = PAGE_SIZE * 2; i < AREA_SIZE; i++)
+    {
+        pFlash[i] = ((i & 0x0F) == 0) ? 0xFF : (uint8_t)i;
+    }
+
+    test_read();
+    test_compare();
+    test_blank();
+    test_bench();
+    return TEST_RESULT();
+}
+
+
+/****************************** End of file ***********************************/
@@ -0,0 +1,160 @@
+/**
+ ******************************************************************************
+ * @file    test_iap_state.c
+ * @author  lizdDong
+ * @version V1.0
+ * @date    2026-10-17
+ * @brief   The boot state journal of iap_state.c on the simulated flash: the
+ *          application flag in slot 0 or appended, the records after it, the
+ *          clear and the compaction of a full page. A flash error stops a write where
+ *          a power loss would, the state read after it must be the previous
+ *          or the new one.
+ * @attention
+ *
+ ******************************************************************************
+ */
+
+#include <string.h>
+#include "stm32f10x.h"
+#include "dev_flash.h"
+#include "iap_state.h"
+#include "sim.h"
+#include "test.h"
+
+
+#define SLOTS                (PAGE_SIZE / 2)
+
+static uint16_t *const Journal = (uint16_t *)IAP_FLAG_ADDR;
+
+/* Both pages blank, the first n records of the journal page written */
+static void test_journal(uint32_t n)
+{
+    uint32_t i;
+
+    sim_flashProtect(0);
+    memset(Journal, 0xFF, PAGE_SIZE * 2);
+    for(i = 1; i <= n; i++)
+    {
+        Journal[i] = IAP_STATE_COPY(i & 0x7F);
+    }
+    sim_flashProtect(1);
+    memset(&SimFlashStat, 0, sizeof(SimFlashStat));
+}
+
+static void test_app(void)
+{
+    uint16_t flag = IAP_FLAG;
+
+    test_journal(0);
+    CHECK(iap_stateRead() == IAP_STATE_NONE);
+    /* What the application does */
+    CHECK(dev_flashErasePage(IAP_FLAG_ADDR) == 0);
+    CHECK(dev_flashProgram(IAP_FLAG_ADDR, (const uint8_t *)&flag, 2) == 0);
+    CHECK(iap_stateRead() == IAP_FLAG);
+
+    CHECK(iap_stateWrite(IAP_STATE_COPY(0)) == 0);
+    CHECK(iap_stateWrite(IAP_STATE_COPY(1)) == 0);
+    CHECK(iap_stateRead() == IAP_STATE_COPY(1));
+    CHECK((Journal[0] == IAP_FLAG) && (Journal[1] == IAP_STATE_COPY(0)) && (Journal[2] == IAP_STATE_COPY(1)));
+    /* Same state: nothing written */
+    CHECK(iap_stateWrite(IAP_STATE_COPY(1)) == 0);
+    CHECK(Journal[3] == 0xFFFF);
+
+    /* Cleared by one record, no erase */
+    memset(&SimFlashStat, 0, sizeof(SimFlashStat));
+    CHECK(iap_stateWrite(IAP_STATE_NONE) == 0);
+    CHECK(iap_stateRead() == IAP_STATE_NONE);
+    CHECK(Journal[3] == IAP_STATE_NONE);
+    CHECK((SimFlashStat.erases == 0) && (SimFlashStat.programs == 1));
+    CHECK(iap_stateWrite(0x1234) == -1);
+
+    /* The application appends its flag in the first blank slot */
+    CHECK(dev_flashProgram(IAP_FLAG_ADDR + 4 * 2, (const uint8_t *)&flag, 2) == 0);
+    CHECK(iap_stateRead() == IAP_FLAG);
+    CHECK(iap_stateWrite(IAP_STATE_NONE) == 0);
+    CHECK(iap_stateRead() == IAP_STATE_NONE);
+
+    /* The bootloader asks for the copy itself: slot 0 stays free */
+    test_journal(0);
+    CHECK(iap_stateWrite(IAP_FLAG) == 0);
+    CHECK((Journal[0] == 0xFFFF) && (Journal[1] == IAP_FLAG));
+    CHECK(iap_stateRead() == IAP_FLAG);
+}
+
+static void test_compact(void)
+{
+    test_journal(SLOTS - 1);
+    CHECK(iap_stateRead() == IAP_STATE_COPY((SLOTS - 1) & 0x7F));
+    CHECK(iap_stateWrite(IAP_FLAG) == 0);
+    CHECK(iap_stateRead() == IAP_FLAG);
+    CHECK((Journal[0] == 0xFFFF) && (Journal[1] == IAP_FLAG) && (Journal[2] == 0xFFFF));
+    CHECK(dev_flashIsBlank(IAP_STATE_SPARE_ADDR, PAGE_SIZE) == 1);
+    /* Spare programmed, journal erased, record, spare erased */
+    CHECK((SimFlashStat.erases == 2) && (SimFlashStat.programs == 2));
+}
+
+static void test_broken(void)
+{
+    uint16_t old = IAP_STATE_COPY((SLOTS - 1) & 0x7F), flag = IAP_FLAG, state;
+    uint32_t k;
+
+    /* Stop the compaction before each of its operations */
+    for(k = 1; k <= 4; k++)
+    {
+        test_journal(SLOTS - 1);
+        SimFlashStat.fail_at = k;
+        CHECK(iap_stateWrite(IAP_FLAG) == -1);
+        state = iap_stateRead();
+        CHECK((state == old) || (state == IAP_FLAG));
+        CHECK((k < 2) || (state == IAP_FLAG));
+
+        /* The next write finishes the compaction */
+        SimFlashStat.fail_at = 0;
+        CHECK(iap_stateWrite(IAP_STATE_COPY(3)) == 0);
+        CHECK(iap_stateRead() == IAP_STATE_COPY(3));
+        CHECK(dev_flashIsBlank(IAP_STATE_SPARE_ADDR, PAGE_SIZE) == 1);
+        CHECK(iap_stateWrite(IAP_STATE_NONE) == 0);
+        CHECK(iap_stateRead() == IAP_STATE_NONE);
+    }
+
+    /* Clear of a full page broken in its compaction: the previous or the
+       new state */
+    for(k = 1; k <= 4; k++)
+    {
+        test_journal(SLOTS - 1);
+        SimFlashStat.fail_at = k;
+        CHECK(iap_stateWrite(IAP_STATE_NONE) == -1);
+        state = iap_stateRead();
+        CHECK((state == old) || (state == IAP_STATE_NONE));
+        SimFlashStat.fail_at = 0;
+        CHECK(iap_stateWrite(IAP_STATE_NONE) == 0);
+        CHECK(iap_stateRead() == IAP_STATE_NONE);
+
+        /* The flag of the application wins over the record left in the
+           spare page */
+        if(Journal[1] == IAP_STATE_NONE)
+        {
+            CHECK(dev_flashProgram(IAP_FLAG_ADDR + 2 * 2, (const uint8_t *)&flag, 2) == 0);
+        }
+        else
+        {
+            CHECK(dev_flashErasePage(IAP_FLAG_ADDR) == 0);
+            CHECK(dev_flashProgram(IAP_FLAG_ADDR, (const uint8_t *)&flag, 2) == 0);
+        }
+        CHECK(iap_stateRead() == IAP_FLAG);
+    }
+}
+
+int main(void)
+{
+    sim_flashMap();
+    sim_flashProtect(1);
+
+    test_app();
+    test_compact();
+    test_broken();
+    return TEST_RESULT();
+}
+
+
+/****************************** End of file ***********************************/
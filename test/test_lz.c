@@ -0,0 +1,267 @@
+/**
+ ******************************************************************************
+ * @file    test_lz.c
+ * @author  lizdDong
+ * @version V1.0
+ * @date    2026-10-17
+ * @brief   Round trips of iap_lz.c against a heatshrink encoder, the input
+ *          and the output cut in random pieces as Ymodem and flash_unpack()
+ *          feed them, then the decoding speed. Built once per window, see
+ *          CMakeLists.txt.
+ * @attention
+ *
+ ******************************************************************************
+ */
+
+#include <string.h>
+#include <time.h>
+#include "iap_cfg.h"
+#include "iap_lz.h"
+#include "test.h"
+
+
+#define DATA_SIZE            (1024 * 64)
+#define BENCH_LOOPS          (32)
+#define BENCH_CHUNK          PAGE_SIZE      /* gaFlashTemp of flash_unpack() */
+
+/* Longest back reference, the length - 1 takes IAP_LZ_LOOKAHEAD bits */
+#define LZ_MAX_COUNT         (1u << IAP_LZ_LOOKAHEAD)
+
+static uint8_t Data[DATA_SIZE];
+static uint8_t Packed[DATA_SIZE * 9 / 8 + 16];
+static uint8_t Unpacked[DATA_SIZE + 16];
+static iap_lz_t Lz;
+
+typedef struct
+{
+    uint8_t *out;
+    uint32_t size;
+    uint32_t bits;
+    uint32_t bitCount;
+} lz_writer_t;
+
+static void lz_put(lz_writer_t *w, uint32_t value, uint32_t width)
+{
+    while(width-- != 0)
+    {
+        w->bits = (w->bits << 1) | ((value >> width) & 1);
+        if(++w->bitCount == 8)
+        {
+            w->out[w->size++] = (uint8_t)w->bits;
+            w->bits = 0;
+            w->bitCount = 0;
+        }
+    }
+}
+
+static uint32_t lz_end(lz_writer_t *w)
+{
+    /* heatshrink pads the last byte with zeros */
+    if(w->bitCount != 0)
+    {
+        lz_put(w, 0, 8 - w->bitCount);
+    }
+    return w->size;
+}
+
+/* Greedy LZSS as "heatshrink -e", a back reference only when it takes
+   fewer bits than its literals. The references stay in the input. */
+static uint32_t lz_encode(const uint8_t *in, uint32_t size, uint8_t *out)
+{
+    lz_writer_t w = {out, 0, 0, 0};
+    uint32_t i = 0, d, len, maxLen, bestLen, bestDist;
+
+    while(i < size)
+    {
+        maxLen = (size - i < LZ_MAX_COUNT) ? (size - i) : LZ_MAX_COUNT;
+        bestLen = 0;
+        bestDist = 0;
+        for(d = 1; (d <= i) && (d <= IAP_LZ_WINDOW_SIZE) && (bestLen < maxLen); d++)
+        {
+            for(len = 0; (len < maxLen) && (in[i - d + len] == in[i + len]); len++);
+            if(len > bestLen)
+            {
+                bestLen = len;
+                bestDist = d;
+            }
+        }
+        if(bestLen * 9 > 1 + IAP_LZ_WINDOW + IAP_LZ_LOOKAHEAD)
+        {
+            lz_put(&w, 0, 1);
+            lz_put(&w, bestDist - 1, IAP_LZ_WINDOW);
+            lz_put(&w, bestLen - 1, IAP_LZ_LOOKAHEAD);
+            i += bestLen;
+        }
+        else
+        {
+            lz_put(&w, 1, 1);
+            lz_put(&w, in[i], 8);
+            i++;
+        }
+    }
+    return lz_end(&w);
+}
+
+static double test_seconds(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* Code like data: a few frequent bytes and copies of earlier runs */
+static void test_fill(uint8_t *data, uint32_t size)
+{
+    static const uint8_t common[] = {0x00, 0x20, 0x46, 0x68, 0x70, 0xB5, 0xBD, 0xD0, 0xE7, 0xF0, 0xF7, 0xFF};
+    uint32_t i = 0, n, d;
+
+    while(i < size)
+    {
+        if((i > 64) && ((test_rand() & 1) != 0))
+        {
+            n = 3 + test_rand() % 40;
+            d = 1 + test_rand() % ((i < 4096) ? i : 4096);
+            for(; (n != 0) && (i < size); n--, i++)
+            {
+                data[i] = data[i - d];
+            }
+        }
+        else
+        {
+            n = 1 + test_rand() % 8;
+            for(; (n != 0) && (i < size); n--, i++)
+            {
+                data[i] = ((test_rand() & 3) != 0) ? common[test_rand() % sizeof(common)] : (uint8_t)test_rand();
+            }
+        }
+    }
+}
+
+/* Decode with the input and the output cut in random pieces */
+static void test_round_trip(const uint8_t *data, uint32_t size, uint32_t maxIn, uint32_t maxOut)
+{
+    const uint8_t *pIn = Packed;
+    uint32_t packed, left, n, in, out = 0, stall = 0;
+
+    packed = lz_encode(data, size, Packed);
+    CHECK(packed <= size * 9 / 8 + 1);
+    iap_lzInit(&Lz);
+    memset(Unpacked, 0xA5, sizeof(Unpacked));
+    left = 0;
+    while((out < size) && (stall < 4))
+    {
+        in = 1 + test_rand() % maxIn;
+        if(in > packed - (uint32_t)(pIn - Packed) - left)
+        {
+            in = packed - (uint32_t)(pIn - Packed) - left;
+        }
+        left += in;
+        n = 1 + test_rand() % maxOut;
+        if(n > size - out)
+        {
+            n = size - out;
+        }
+        n = iap_lzDecode(&Lz, &pIn, &left, Unpacked + out, n);
+        out += n;
+        stall = ((n == 0) && (in == 0)) ? stall + 1 : 0;
+    }
+    CHECK(out == size);
+    CHECK(memcmp(Unpacked, data, size) == 0);
+    /* Nothing written past the room given */
+    CHECK(Unpacked[size] == 0xA5);
+    /* At most the zero padding of the last byte is left */
+    CHECK(packed - (uint32_t)(pIn - Packed) <= 1);
+}
+
+static void test_round_trips(void)
+{
+    uint32_t i, size;
+
+    /* Empty, one byte, runs made of overlapping references */
+    test_round_trip(Data, 0, 16, 16);
+    test_round_trip(Data, 1, 1, 1);
+    for(i = 0; i < 3000; i++)
+    {
+        Data[i] = (uint8_t)(i / 700);
+    }
+    test_round_trip(Data, 3000, 1, 1);
+    test_round_trip(Data, 3000, 64, 2048);
+
+    /* Incompressible */
+    for(i = 0; i < DATA_SIZE; i++)
+    {
+        Data[i] = (uint8_t)test_rand();
+    }
+    test_round_trip(Data, 4096, 7, 33);
+
+    /* Code like, sizes around the window and the pages */
+    test_fill(Data, DATA_SIZE);
+    for(size = 1; size < DATA_SIZE; size = size * 3 + 1)
+    {
+        test_round_trip(Data, size, 1 + size % 97, 1 + size % 301);
+    }
+    test_round_trip(Data, DATA_SIZE, 1029, BENCH_CHUNK);
+}
+
+/* A reference before the first byte reads the zeros of the window */
+static void test_initial_window(void)
+{
+    uint8_t stream[8], out[8];
+    lz_writer_t w = {stream, 0, 0, 0};
+    const uint8_t *pIn = stream;
+    uint32_t size;
+
+    lz_put(&w, 1, 1);
+    lz_put(&w, 0x55, 8);
+    lz_put(&w, 0, 1);
+    lz_put(&w, 4, IAP_LZ_WINDOW);
+    lz_put(&w, 2, IAP_LZ_LOOKAHEAD);
+    size = lz_end(&w);
+
+    iap_lzInit(&Lz);
+    memset(out, 0xA5, sizeof(out));
+    CHECK(iap_lzDecode(&Lz, &pIn, &size, out, 4) == 4);
+    CHECK((out[0] == 0x55) && (out[1] == 0) && (out[2] == 0) && (out[3] == 0) && (out[4] == 0xA5));
+}
+
+static void test_bench(void)
+{
+    const uint8_t *pIn;
+    uint32_t packed, left, out, i;
+    double t0, t1;
+
+    test_fill(Data, DATA_SIZE);
+    packed = lz_encode(Data, DATA_SIZE, Packed);
+
+    t0 = test_seconds();
+    for(i = 0; i < BENCH_LOOPS; i++)
+    {
+        iap_lzInit(&Lz);
+        pIn = Packed;
+        left = packed;
+        for(out = 0; out < DATA_SIZE;)
+        {
+            out += iap_lzDecode(&Lz, &pIn, &left, Unpacked + out,
+                                (DATA_SIZE - out < BENCH_CHUNK) ? (DATA_SIZE - out) : BENCH_CHUNK);
+        }
+    }
+    t1 = test_seconds();
+    CHECK(memcmp(Unpacked, Data, DATA_SIZE) == 0);
+
+    printf("IAP_LZ_WINDOW %d, IAP_LZ_LOOKAHEAD %d: %d -> %d bytes (%.1f%%), decode %.1f MB/s, %.2f ns/byte\n",
+           IAP_LZ_WINDOW, IAP_LZ_LOOKAHEAD, DATA_SIZE, packed, packed * 100.0 / DATA_SIZE,
+           (double)DATA_SIZE * BENCH_LOOPS / (t1 - t0) / 1e6,
+           (t1 - t0) * 1e9 / ((double)DATA_SIZE * BENCH_LOOPS));
+}
+
+int main(void)
+{
+    test_initial_window();
+    test_round_trips();
+    test_bench();
+    return TEST_RESULT();
+}
+
+
+/****************************** End of file ***********************************/
@@ -0,0 +1,109 @@
+/**
+ ******************************************************************************
+ * @file    test_uart_ring.c
+ * @author  lizdDong
+ * @version V1.0
+ * @date    2026-10-17
+ * @brief   dev_uart.c against a simulated DMA producer: bursts of random
+ *          length fill the ring while the reader takes random amounts, the
+ *          bytes must come out in order across many wraps.
+ * @attention
+ *
+ ******************************************************************************
+ */
+
+#include "stm32f10x.h"
+#include "iap_cfg.h"
+#include "dev_uart.h"
+#include "sim.h"
+#include "test.h"
+
+
+#if (USART_PORT_USE == 1)
+#define UART_RX_DMA_CH       DMA1_Channel5
+#else
+#define UART_RX_DMA_CH       DMA1_Channel3
+#endif
+
+#define TEST_BYTES           (UART_RX_BUF_SIZE * 64)
+
+static uint8_t test_byte(uint32_t n)
+{
+    return (uint8_t)(n * 7 + (n >> 8));
+}
+
+static void test_stream(void)
+{
+    uint32_t sent = 0, read = 0, n, i;
+    uint8_t c;
+
+    dev_uartInit();
+    CHECK(dev_uartAvailable() == 0);
+    CHECK(dev_uartGetc(&c) == -1);
+
+    while(read < TEST_BYTES)
+    {
+        /* Producer: a burst that fits in the free part of the ring */
+        n = test_rand() % UART_RX_BUF_SIZE;
+        if(n > UART_RX_BUF_SIZE - 1 - (sent - read))
+        {
+            n = UART_RX_BUF_SIZE - 1 - (sent - read);
+        }
+        for(i = 0; i < n; i++, sent++)
+        {
+            sim_dmaPut(UART_RX_DMA_CH, test_byte(sent));
+        }
+        CHECK(dev_uartAvailable() == sent - read);
+
+        /* Consumer: any amount, one more than available to hit the empty case */
+        n = test_rand() % (sent - read + 2);
+        for(i = 0; i < n; i++)
+        {
+            if(dev_uartGetc(&c) != 0)
+            {
+                CHECK(read == sent);
+                break;
+            }
+            CHECK(c == test_byte(read));
+            read++;
+        }
+        if(TestFailures != 0)
+        {
+            break;
+        }
+    }
+}
+
+static void test_flush(void)
+{
+    uint32_t i;
+    uint8_t c;
+
+    dev_uartInit();
+    for(i = 0; i < UART_RX_BUF_SIZE / 2 + 3; i++)
+    {
+        sim_dmaPut(UART_RX_DMA_CH, (uint8_t)i);
+    }
+    dev_uartFlush();
+    CHECK(dev_uartAvailable() == 0);
+    sim_dmaPut(UART_RX_DMA_CH, 0x5A);
+    CHECK((dev_uartGetc(&c) == 0) && (c == 0x5A));
+    CHECK(dev_uartGetc(&c) == -1);
+
+    /* Reinit starts over at the beginning of the ring */
+    dev_uartDeinit();
+    dev_uartInit();
+    CHECK(dev_uartAvailable() == 0);
+    sim_dmaPut(UART_RX_DMA_CH, 0xA5);
+    CHECK((dev_uartGetc(&c) == 0) && (c == 0xA5));
+}
+
+int main(void)
+{
+    test_stream();
+    test_flush();
+    return TEST_RESULT();
+}
+
+
+/****************************** End of file ***********************************/
@@ -0,0 +1,226 @@
+/**
+ ******************************************************************************
+ * @file    test_ymodem_window.c
+ * @author  lizdDong
+ * @version V1.0
+ * @date    2026-10-17
+ * @brief   Loopback of Ymodem_Transmit() and Ymodem_Receive() with the
+ *          windowed extension. The sender runs in a child process, each
+ *          side has its own ymodem.c state, the line is a pair of pipes.
+ *          Data packets of the sender are lost or corrupted at a given
+ *          rate, or lost by sequence number several per window, the file
+ *          must arrive whole in the dev_flashSim backend and the goodput is
+ *          printed against the loss.
+ * @attention
+ *
+ ******************************************************************************
+ */
+
+#include <fcntl.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include "stm32f10x.h"
+#include "iap_cfg.h"
+#include "ymodem.h"
+#include "dev_flash.h"
+#include "dev_flash_sim.h"
+#include "sim.h"
+#include "test.h"
+
+
+#define FILE_SIZE            (60 * 1024 + 123)
+#define DATA_PACKET_SIZE     (PACKET_1KB_SIZE + PACKET_OVERHEAD)
+
+/* Counted by the sender, shared with the receiver */
+typedef struct
+{
+    uint32_t wire;                  /* bytes sent, lost ones included */
+    uint32_t packets;               /* data packets sent */
+    uint32_t lost;                  /* data packets lost or corrupted */
+    int32_t result;                 /* of Ymodem_Transmit() */
+} test_link_t;
+
+uint8_t tab_1024[1024];
+
+static test_link_t *Link;
+static int RxFd, TxFd;
+static uint32_t LossPercent;
+static uint32_t PacketLeft, PacketFate, PacketByte;
+static const uint8_t *DropSeq;      /* first copy of these packets is lost */
+static uint32_t DropCount, Dropped;
+static uint8_t File[FILE_SIZE];
+static uint8_t Back[FILE_SIZE];
+static uint32_t RecvBuf[YMODEM_RECV_BUF_SIZE / 4];
+
+int32_t dev_uartGetc(uint8_t *c)
+{
+    return (read(RxFd, c, 1) == 1) ? 0 : -1;
+}
+
+static void test_senderWrite(uint8_t c)
+{
+    if(write(TxFd, &c, 1) != 1)
+    {
+        _exit(2);
+    }
+}
+
+/* The first copy of a packet of DropSeq[] is lost */
+static uint32_t test_senderDrop(uint8_t seqno)
+{
+    uint32_t i;
+
+    for(i = 0; i < DropCount; i++)
+    {
+        if((DropSeq[i] == seqno) && ((Dropped & (1u << i)) == 0))
+        {
+            Dropped |= 1u << i;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* The sender side of the line: a data packet is kept, dropped whole (1) or
+   has one byte flipped (2). STX goes out with the sequence number, which
+   decides on the packets of DropSeq[]. */
+static void test_senderTx(USART_TypeDef *usart, uint8_t c)
+{
+    (void)usart;
+    Link->wire++;
+    if((PacketLeft == 0) && (c == STX))
+    {
+        PacketLeft = DATA_PACKET_SIZE;
+        PacketFate = 0;
+        Link->packets++;
+        if(test_rand() % 100 < LossPercent)
+        {
+            PacketFate = 1 + test_rand() % 2;
+            PacketByte = test_rand() % (DATA_PACKET_SIZE - PACKET_HEADER);
+            Link->lost++;
+        }
+    }
+    if(PacketLeft != 0)
+    {
+        PacketLeft--;
+        if(PacketLeft == DATA_PACKET_SIZE - 1)
+        {
+            return;
+        }
+        if(PacketLeft == DATA_PACKET_SIZE - 1 - PACKET_SEQNO_INDEX)
+        {
+            if((PacketFate == 0) && (test_senderDrop(c) != 0))
+            {
+                PacketFate = 1;
+                Link->lost++;
+            }
+            if(PacketFate != 1)
+            {
+                test_senderWrite(STX);
+            }
+        }
+        if(PacketFate == 1)
+        {
+            return;
+        }
+        if((PacketFate == 2) && (PacketLeft == PacketByte))
+        {
+            c ^= 0x5A;
+        }
+    }
+    test_senderWrite(c);
+}
+
+static void test_receiverTx(USART_TypeDef *usart, uint8_t c)
+{
+    (void)usart;
+    if(write(TxFd, &c, 1) != 1)
+    {
+        CHECK(0);
+    }
+}
+
+static void test_transfer(uint32_t loss, const uint8_t *drop, uint32_t dropCount)
+{
+    int toReceiver[2], toSender[2];
+    struct timespec t0, t1;
+    uint32_t ms;
+    int32_t size;
+    pid_t pid;
+
+    CHECK((pipe(toReceiver) == 0) && (pipe(toSender) == 0));
+    memset(Link, 0, sizeof(*Link));
+    LossPercent = loss;
+    DropSeq = drop;
+    DropCount = dropCount;
+    Dropped = 0;
+    TestSeed = 1000 + loss;
+    pid = fork();
+    if(pid == 0)
+    {
+        RxFd = toSender[0];
+        TxFd = toReceiver[1];
+        fcntl(RxFd, F_SETFL, O_NONBLOCK);
+        sim_usartTx = test_senderTx;
+        sim_tickStart();
+        Link->result = Ymodem_Transmit(File, (const uint8_t *)"test.bin", FILE_SIZE);
+        _exit(0);
+    }
+
+    RxFd = toReceiver[0];
+    TxFd = toSender[1];
+    fcntl(RxFd, F_SETFL, O_NONBLOCK);
+    sim_usartTx = test_receiverTx;
+    dev_flashSimFill(0xFF);
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    size = Ymodem_Receive((uint8_t *)RecvBuf);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    waitpid(pid, 0, 0);
+    close(toReceiver[0]);
+    close(toReceiver[1]);
+    close(toSender[0]);
+    close(toSender[1]);
+    ms = (uint32_t)((t1.tv_sec - t0.tv_sec) * 1000 + (t1.tv_nsec - t0.tv_nsec) / 1000000);
+
+    CHECK(size == FILE_SIZE);
+    CHECK(dev_flashRead(ApplicationAddress, Back, FILE_SIZE) == FILE_SIZE);
+    CHECK(memcmp(Back, File, FILE_SIZE) == 0);
+    /* The 0x1A padding of the last packet is not programmed */
+    CHECK(dev_flashRead(ApplicationAddress + FILE_SIZE, Back, 4) == 4);
+    CHECK((Back[0] == 0xFF) && (Back[1] == 0xFF) && (Back[2] == 0xFF) && (Back[3] == 0xFF));
+    /* Only the lost packets and the outstanding ones at each loss are sent again */
+    CHECK(Link->packets <= (FILE_SIZE / PACKET_1KB_SIZE + 1) + Link->lost * YMODEM_W_SIZE);
+    printf("loss %2u%%, %u dropped: %3u packets, %2u lost, efficiency %3u%%, goodput %5u B/s at %u baud, %u ms\n",
+           loss, dropCount, Link->packets, Link->lost, (uint32_t)((uint64_t)FILE_SIZE * 100 / Link->wire),
+           (uint32_t)((uint64_t)FILE_SIZE * COM_BAUDRATE / 10 / Link->wire), COM_BAUDRATE, ms);
+}
+
+int main(void)
+{
+    static const uint32_t loss[] = {0, 2, 5, 10};
+    /* Several packets missing at once, apart from each other: the NAK mask
+       has holes and only the missing ones come again */
+    static const uint8_t drop[] = {3, 5, 10, 12, 13, 20, 23};
+    uint32_t i;
+
+    Link = mmap(0, sizeof(*Link), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    for(i = 0; i < FILE_SIZE; i++)
+    {
+        File[i] = (uint8_t)test_rand();
+    }
+    sim_tickStart();
+    CHECK(dev_flashSetBackend(&dev_flashSim) == 0);
+    for(i = 0; i < sizeof(loss) / sizeof(loss[0]); i++)
+    {
+        test_transfer(loss[i], 0, 0);
+    }
+    test_transfer(0, drop, sizeof(drop));
+    CHECK(Link->lost == sizeof(drop));
+    return TEST_RESULT();
+}
+
+
+/****************************** End of file ***********************************/
@@ -0,0 +1,33 @@
+/**
+  ******************************************************************************
+  * @file    crc16.h
+  * @author  lizdDong
+  * @version V1.0
+  * @date    2026-10-17
+  * @brief   CRC16-CCITT of the Ymodem packets.
+  * @attention
+  *
+  ******************************************************************************
+  */
+
+#ifndef _CRC16_H_
+#define _CRC16_H_
+
+#include <stdint.h>
+
+
+#define CRC16_POLY               ((uint16_t)0x1021)
+
+/* CRC16_METHOD in iap_cfg.h */
+#define CRC16_METHOD_BIT         0   /* bit loop, no table */
+#define CRC16_METHOD_NIBBLE      1   /* 16 entries table, 32 bytes */
+#define CRC16_METHOD_TABLE       2   /* 256 entries table, 512 bytes */
+#define CRC16_METHOD_SLICE4      3   /* 4 x 256 entries table, 2 KBytes */
+
+
+uint16_t crc16_update(uint16_t crc, uint8_t byte);
+uint16_t crc16_calc(uint16_t crc, const uint8_t *data, uint32_t size);
+
+
+#endif
+
@@ -29,23 +29,73 @@
 #include "stm32f10x.h"
 #include "ymodem.h"
 #include "iap_cfg.h"
+#include "dev_uart.h"
+#include "crc16.h"
+#include "dev_timer.h"
+#if (YMODEM_LZ_EN)
+#include "iap_lz.h"
+#endif
+#if (IAP_DUAL_SLOT)
+#include "iap_image.h"
+#endif
 
 /* Private typedef -----------------------------------------------------------*/
+typedef struct
+{
+    const uint8_t *src;     /* payload waiting in PageBuf[] */
+    uint32_t dst;           /* flash address of the next word */
+    uint32_t count;         /* bytes left to program */
+    uint32_t erase;         /* page erased before the first word, 0: none */
+    FLASH_Status status;    /* first error of the payload */
+    const uint8_t *page_src;    /* whole payload, verified once programmed */
+    uint32_t page_dst;
+    uint32_t page_size;
+    uint32_t retried;       /* the page was erased and programmed again */
+} ProgramJob_TypeDef;
+
 /* Private define ------------------------------------------------------------*/
+#define PROGRAM_STEP_WORDS      (8)     /* words programmed per idle poll of Receive_Byte */
+
+
+#if (YMODEM_W_EN) && (YMODEM_W_SIZE > 8)
+#error "YMODEM_W_SIZE must be 8 at most, the NAK mask is one byte."
+#endif
+
 /* Private macro -------------------------------------------------------------*/
+#define WINDOW_SLOT(buf, k)     ((buf) + (k) * PACKET_SLOT_SIZE + PACKET_ALIGN_OFFSET)
+
 /* Private variables ---------------------------------------------------------*/
 uint8_t file_name[FILE_NAME_LENGTH];
 uint32_t FlashDestination = ApplicationAddress; /* Flash user program offset */
+static uint32_t FlashBase = ApplicationAddress; /* slot the file is received into */
 uint16_t PageSize = PAGE_SIZE;
 //uint32_t EraseCounter = 0x0;
 //uint32_t NbrOfPage = 0;
 //FLASH_Status FLASHStatus = FLASH_COMPLETE;
-uint32_t RamSource;
 extern uint8_t tab_1024[1024];
+static ProgramJob_TypeDef ProgramJob = {0, 0, 0, 0, FLASH_COMPLETE, 0, 0, 0, 0};
+static uint32_t PageBuf[2][PAGE_SIZE / 4];  /* page being filled, page being programmed */
+static uint32_t PageIdx;        /* PageBuf[] being filled */
+static uint32_t PageAddr;       /* flash address of its first byte */
+static uint32_t PageFill;       /* bytes received in it, 0: empty */
+static uint32_t PageCmp;        /* dev_flashCompare() of these bytes */
+
+#if (YMODEM_G_RESUME)
+static uint32_t ResumeStart;    /* flash address of the file broken in Ymodem-G */
+#endif
+static uint32_t FileReceived;   /* bytes of the file received */
+#if (YMODEM_LZ_EN)
+static uint32_t LzOn;           /* the file is compressed */
+static iap_lz_t Lz;
+static uint32_t LzBuf[YMODEM_LZ_BUF_SIZE / 4];  /* output of Lz, by word */
+static uint32_t LzFill;         /* bytes in LzBuf */
+#endif
+Ymodem_StatTypeDef YmodemStat;
 
 /* Private function prototypes -----------------------------------------------*/
 static void Int2Str(uint8_t *p_str, uint32_t intnum);
 static uint32_t Str2Int(uint8_t *p_inputstr, uint32_t *p_intnum);
+static uint32_t Program_Step(void);
 
 
 /* Private functions ---------------------------------------------------------*/
@@ -53,23 +103,39 @@ static uint32_t Str2Int(uint8_t *p_inputstr, uint32_t *p_intnum);
 /**
   * @brief  Receive byte from sender
   * @param  c: Character
-  * @param  timeout: Timeout
+  * @param  timeout: Timeout in ms, 0 to poll once
   * @retval 0: Byte received
   *         -1: Timeout
   */
 int32_t Receive_Byte(uint8_t *c, uint32_t timeout)
 {
-    while(timeout-- > 0)
+    uint32_t deadline = dev_timerDeadline(timeout);
+
+    do
     {
-        if(USART_GetFlagStatus(COM_PORT, USART_FLAG_RXNE) != RESET)
+        if(dev_uartGetc(c) == 0)
         {
-            *c = (uint8_t)COM_PORT->DR;
             return 0;
         }
+        /* Nothing to parse, go on with the pending payload */
+        Program_Step();
     }
+    while(dev_timerExpired(deadline) == 0);
     return -1;
 }
 
+/**
+  * @brief  Drop the bytes until the line is idle for BYTE_TIMEOUT
+  * @param  None
+  * @retval None
+  */
+static void Receive_Purge(void)
+{
+    uint8_t c;
+
+    while(Receive_Byte(&c, BYTE_TIMEOUT) == 0);
+}
+
 /**
   * @brief  Send a byte
   * @param  c: Character
@@ -106,17 +172,20 @@ uint32_t Send_String(char *pstr)
   * @brief  Receive a packet from sender
   * @param  data
   * @param  length
-  * @param  timeout
+  * @param  timeout: Timeout of the first byte in ms, the next bytes use BYTE_TIMEOUT
   *     0: end of transmission
   *    -1: abort by sender
   *    >0: packet length
+  * @note   The CRC16 is updated as each byte arrives, the packet passes when
+  *         the payload and its two trailer bytes leave a zero remainder.
   * @retval 0: normally return
   *        -1: timeout or packet error
+  *        -2: CRC error
   *         1: abort by user
   */
 static int32_t Receive_Packet(uint8_t *data, int32_t *length, uint32_t timeout)
 {
-    uint16_t i, packet_size;
+    uint16_t i, packet_size, crc;
     uint8_t c;
     *length = 0;
     if(Receive_Byte(&c, timeout) != 0)
@@ -157,7 +226,7 @@ static int32_t Receive_Packet(uint8_t *data, int32_t *length, uint32_t timeout)
         case EOT:
             return 0;
         case CA:
-            if((Receive_Byte(&c, timeout) == 0) && (c == CA))
+            if((Receive_Byte(&c, BYTE_TIMEOUT) == 0) && (c == CA))
             {
                 *length = -1;
                 return 0;
@@ -173,39 +242,647 @@ static int32_t Receive_Packet(uint8_t *data, int32_t *length, uint32_t timeout)
             return -1;
     }
     *data = c;
-    for(i = 1; i < (packet_size + PACKET_OVERHEAD); i ++)
+    for(i = 1; i < PACKET_HEADER; i ++)
+    {
+        if(Receive_Byte(data + i, BYTE_TIMEOUT) != 0)
+        {
+            return -1;
+        }
+    }
+    for(crc = 0; i < (packet_size + PACKET_OVERHEAD); i ++)
     {
-        if(Receive_Byte(data + i, timeout) != 0)
+        if(Receive_Byte(data + i, BYTE_TIMEOUT) != 0)
         {
             return -1;
         }
+        crc = crc16_update(crc, data[i]);
     }
     if(data[PACKET_SEQNO_INDEX] != ((data[PACKET_SEQNO_COMP_INDEX] ^ 0xff) & 0xff))
     {
         return -1;
     }
+    if(crc != 0)
+    {
+        return -2;
+    }
     *length = packet_size;
     return 0;
 }
 
 
+/**
+  * @brief  Queue a received page to be programmed while the next one is
+  *         being received
+  * @param  src: Data in PageBuf[], word aligned
+  * @param  dst: Flash address
+  * @param  count: Number of bytes, rounded up to a word
+  * @param  erase: Page erased before the first word, 0: none
+  * @retval None
+  */
+static void Program_Start(const uint8_t *src, uint32_t dst, uint32_t count, uint32_t erase)
+{
+    ProgramJob.src = src;
+    ProgramJob.dst = dst;
+    ProgramJob.count = (count + 3) & ~3u;
+    ProgramJob.erase = erase;
+    ProgramJob.page_src = ProgramJob.src;
+    ProgramJob.page_dst = ProgramJob.dst;
+    ProgramJob.page_size = ProgramJob.count;
+    ProgramJob.retried = 0;
+}
+
+/**
+  * @brief  Program the pending payload again from its start, once
+  * @note   The payload is still in PageBuf[] although its packets are
+  *         acknowledged already, so the page is erased and rewritten from
+  *         there instead of asking the sender for the packets.
+  * @param  None
+  * @retval None
+  */
+static void Program_Retry(void)
+{
+    if(ProgramJob.retried != 0)
+    {
+        ProgramJob.status = FLASH_ERROR_PG;
+        ProgramJob.count = 0;
+        return;
+    }
+    ProgramJob.retried = 1;
+    ProgramJob.src = ProgramJob.page_src;
+    ProgramJob.dst = ProgramJob.page_dst;
+    ProgramJob.count = ProgramJob.page_size;
+    ProgramJob.erase = ProgramJob.page_dst & ~(PAGE_SIZE - 1);
+    YmodemStat.rewritten_pages++;
+}
+
+/**
+  * @brief  Program at most PROGRAM_STEP_WORDS words of the pending payload
+  * @note   The page of the payload is erased by dev_flashErasePage() in
+  *         one step. The flash has a single bank and this code runs from
+  *         it, an asynchronous erase would stall it on the next fetch all
+  *         the same. Only the UART DMA and the interrupts in SRAM go on,
+  *         the bytes kept by the DMA are parsed once the erase is over.
+  *         The words are programmed by dev_flashProgram(), the whole
+  *         payload is compared with the flash in one pass after its last
+  *         word.
+  * @param  None
+  * @retval 0: Nothing left to program
+  *         1: Payload still pending
+  */
+static uint32_t Program_Step(void)
+{
+    uint32_t n;
+
+    if(ProgramJob.count == 0)
+    {
+        return 0;
+    }
+    if(ProgramJob.erase != 0)
+    {
+        if(dev_flashErasePage(ProgramJob.erase) != 0)
+        {
+            ProgramJob.status = FLASH_ERROR_PG;
+            ProgramJob.count = 0;
+        }
+        ProgramJob.erase = 0;
+    }
+    else
+    {
+        n = (ProgramJob.count < PROGRAM_STEP_WORDS * 4) ? ProgramJob.count : PROGRAM_STEP_WORDS * 4;
+        if(dev_flashProgram(ProgramJob.dst, ProgramJob.src, n) != 0)
+        {
+            Program_Retry();
+        }
+        else
+        {
+            ProgramJob.src += n;
+            ProgramJob.dst += n;
+            ProgramJob.count -= n;
+            if((ProgramJob.count == 0) &&
+               (dev_flashCompare(ProgramJob.page_dst, ProgramJob.page_src, ProgramJob.page_size) != FLASH_CMP_SAME))
+            {
+                Program_Retry();
+            }
+        }
+    }
+    return (ProgramJob.count != 0) ? 1 : 0;
+}
+
+/**
+  * @brief  Finish the pending payload and get its result
+  * @param  None
+  * @retval FLASH_COMPLETE or the first programming error
+  */
+static FLASH_Status Program_Wait(void)
+{
+    FLASH_Status status;
+
+    while(Program_Step() != 0);
+    status = ProgramJob.status;
+    ProgramJob.status = FLASH_COMPLETE;
+    if(status != FLASH_COMPLETE)
+    {
+        /* The session ends, drop the page being received */
+        PageFill = 0;
+    }
+    return status;
+}
+
+/**
+  * @brief  Drop the pending payload when the session is aborted
+  * @param  None
+  * @retval None
+  */
+static void Program_Cancel(void)
+{
+    ProgramJob.count = 0;
+    ProgramJob.status = FLASH_COMPLETE;
+    PageFill = 0;
+}
+
+/**
+  * @brief  Hand the page being received over to Program_Step()
+  * @note   A page identical to the flash is skipped, a page whose new bytes
+  *         only fall on blank half words is programmed without erase.
+  * @param  None
+  * @retval FLASH_COMPLETE or the error of the page programmed before
+  */
+static FLASH_Status Page_Commit(void)
+{
+    FLASH_Status status;
+
+    if(PageFill == 0)
+    {
+        return FLASH_COMPLETE;
+    }
+    /* The other page buffer is free once its page is programmed */
+    status = Program_Wait();
+    if(status != FLASH_COMPLETE)
+    {
+        return status;
+    }
+    if(PageCmp == FLASH_CMP_SAME)
+    {
+        YmodemStat.skipped_pages++;
+    }
+    else
+    {
+        if(PageCmp == FLASH_CMP_WRITE)
+        {
+            YmodemStat.blank_pages++;
+        }
+        Program_Start((const uint8_t *)PageBuf[PageIdx], PageAddr, PageFill,
+                      (PageCmp == FLASH_CMP_ERASE) ? (PageAddr & ~(PAGE_SIZE - 1)) : 0);
+        PageIdx ^= 1;
+    }
+    PageFill = 0;
+    return FLASH_COMPLETE;
+}
+
+/**
+  * @brief  Collect a received payload by flash page
+  * @note   Each chunk is compared with the flash as it comes, the page is
+  *         programmed by Program_Step() while the next one is received.
+  * @param  src: Payload in the packet buffer, word aligned
+  * @param  dst: Flash address
+  * @param  count: Number of bytes, rounded up to a word
+  * @retval FLASH_COMPLETE or the first programming error
+  */
+static FLASH_Status Page_Write(const uint8_t *src, uint32_t dst, uint32_t count)
+{
+    uint32_t n, cmp;
+    FLASH_Status status = FLASH_COMPLETE;
+
+    count = (count + 3) & ~3u;
+    while((count != 0) && (status == FLASH_COMPLETE))
+    {
+        if((PageFill != 0) && (dst != PageAddr + PageFill))
+        {
+            status = Page_Commit();
+            continue;
+        }
+        if(PageFill == 0)
+        {
+            PageAddr = dst;
+            PageCmp = FLASH_CMP_SAME;
+        }
+        n = PAGE_SIZE - (dst & (PAGE_SIZE - 1));
+        if(n > count)
+        {
+            n = count;
+        }
+        memcpy((uint8_t *)PageBuf[PageIdx] + PageFill, src, n);
+        cmp = dev_flashCompare(dst, src, n);
+        if(cmp > PageCmp)
+        {
+            PageCmp = cmp;
+        }
+        PageFill += n;
+        src += n;
+        dst += n;
+        count -= n;
+        if((dst & (PAGE_SIZE - 1)) == 0)
+        {
+            status = Page_Commit();
+        }
+    }
+    return status;
+}
+
+/**
+  * @brief  Program the last page and wait for the end
+  * @param  None
+  * @retval FLASH_COMPLETE or the first programming error
+  */
+static FLASH_Status Page_Flush(void)
+{
+    FLASH_Status status;
+
+    status = Page_Commit();
+    if(status == FLASH_COMPLETE)
+    {
+        status = Program_Wait();
+    }
+    return status;
+}
+
+/**
+  * @brief  Start receiving the data of file_name
+  * @note   With YMODEM_LZ_EN a name ending by YMODEM_LZ_SUFFIX selects
+  *         the decompression.
+  * @param  None
+  * @retval None
+  */
+static void File_Begin(void)
+{
+#if (YMODEM_LZ_EN)
+    uint32_t n = strlen((char *)file_name);
+
+    LzOn = (n > sizeof(YMODEM_LZ_SUFFIX) - 1) &&
+           (strcmp((char *)file_name + n - (sizeof(YMODEM_LZ_SUFFIX) - 1), YMODEM_LZ_SUFFIX) == 0);
+    iap_lzInit(&Lz);
+    LzFill = 0;
+#endif
+    FileReceived = 0;
+}
+
+/**
+  * @brief  Hand the payload of a data packet over to Page_Write()
+  * @note   The padding after the end of the file is dropped. A compressed
+  *         file is decoded into LzBuf first, which goes to Page_Write()
+  *         when it is full so the pages stay contiguous.
+  * @param  src: Payload in the packet buffer, word aligned
+  * @param  length: Length of the payload
+  * @param  size: Size of the file
+  * @retval FLASH_COMPLETE or the first programming error
+  */
+static FLASH_Status File_Write(const uint8_t *src, uint32_t length, uint32_t size)
+{
+    uint32_t count = 0;
+    FLASH_Status status = FLASH_COMPLETE;
+
+    if(FileReceived < size)
+    {
+        count = size - FileReceived;
+        if(count > length)
+        {
+            count = length;
+        }
+    }
+    FileReceived += count;
+#if (YMODEM_LZ_EN)
+    if(LzOn != 0)
+    {
+        while((count != 0) && (status == FLASH_COMPLETE))
+        {
+            LzFill += iap_lzDecode(&Lz, &src, &count, (uint8_t *)LzBuf + LzFill, sizeof(LzBuf) - LzFill);
+            if(LzFill == sizeof(LzBuf))
+            {
+                if(FlashDestination + LzFill > FlashBase + FLASH_IMAGE_SIZE)
+                {
+                    Program_Cancel();
+                    return FLASH_ERROR_PG;
+                }
+                status = Page_Write((const uint8_t *)LzBuf, FlashDestination, LzFill);
+                FlashDestination += LzFill;
+                LzFill = 0;
+            }
+        }
+        return status;
+    }
+#endif
+    if(FlashDestination + count > FlashBase + FLASH_IMAGE_SIZE)
+    {
+        Program_Cancel();
+        return FLASH_ERROR_PG;
+    }
+    if((count & 3) != 0)
+    {
+        /* Page_Write() rounds up to a word, the padding of the sender
+           after the end of the file is not programmed. The payload of a
+           packet is a multiple of 128 bytes, the word fits in it */
+        memset((uint8_t *)src + count, 0xFF, 4 - (count & 3));
+    }
+    status = Page_Write(src, FlashDestination, count);
+    FlashDestination += count;
+    return status;
+}
+
+/**
+  * @brief  Program the rest of the file and wait for the end
+  * @note   With IAP_DUAL_SLOT an image not linked for FlashBase is refused,
+  *         it would never boot.
+  * @param  None
+  * @retval FLASH_COMPLETE or the first programming error
+  */
+static FLASH_Status File_End(void)
+{
+    FLASH_Status status;
+
+#if (YMODEM_LZ_EN)
+    if(LzFill != 0)
+    {
+        /* Page_Write() rounds up to a word, the tail must not carry the
+           bytes of the previous buffer */
+        memset((uint8_t *)LzBuf + LzFill, 0xFF, sizeof(LzBuf) - LzFill);
+        if((FlashDestination + LzFill > FlashBase + FLASH_IMAGE_SIZE) ||
+           (Page_Write((const uint8_t *)LzBuf, FlashDestination, LzFill) != FLASH_COMPLETE))
+        {
+            LzFill = 0;
+            Program_Cancel();
+            return FLASH_ERROR_PG;
+        }
+        FlashDestination += LzFill;
+        LzFill = 0;
+    }
+#endif
+    status = Page_Flush();
+#if (IAP_DUAL_SLOT)
+    if((status == FLASH_COMPLETE) && (iap_imageLinked(FlashBase) == 0))
+    {
+        status = FLASH_ERROR_PG;
+    }
+#endif
+    return status;
+}
+
+#if (YMODEM_W_EN)
+/**
+  * @brief  Get the window offered by the sender in the filename packet
+  * @note   The offer follows the NUL ending the size field: 'W', window.
+  *         A standard receiver stops at that NUL and does not see it.
+  * @param  payload: Payload of the filename packet
+  * @param  length: Length of the payload
+  * @retval 0: No offer
+  *        >0: Window to use, at most YMODEM_W_SIZE
+  */
+static uint32_t Window_Parse(const uint8_t *payload, uint32_t length)
+{
+    uint32_t i;
+
+    /* Skip the file name and the size field */
+    for(i = 0; (i < length) && (payload[i] != 0); i++);
+    for(i++; (i < length) && (payload[i] != 0); i++);
+    i++;
+    if((i + 1 >= length) || (payload[i] != YMODEM_W_MAGIC) || (payload[i + 1] == 0))
+    {
+        return 0;
+    }
+    return (payload[i + 1] < YMODEM_W_SIZE) ? payload[i + 1] : YMODEM_W_SIZE;
+}
+
+/**
+  * @brief  Find the window slot keeping a packet
+  * @param  held: Sequence number kept in each slot, -1 for a free slot
+  * @param  window: Negotiated window
+  * @param  seqno: Sequence number, -1 for a free slot
+  * @retval The slot, window if there is none
+  */
+static uint32_t Window_Find(const int16_t *held, uint32_t window, int16_t seqno)
+{
+    uint32_t k;
+
+    for(k = 0; (k < window) && (held[k] != seqno); k++);
+    return k;
+}
+
+/**
+  * @brief  Ask the sender to repeat the packets missing in the window
+  * @param  held: Sequence number kept in each slot, -1 for a free slot
+  * @param  window: Negotiated window
+  * @param  expected: Next packet to program
+  * @retval None
+  */
+static void Window_Nak(const int16_t *held, uint32_t window, uint32_t expected)
+{
+    uint32_t k;
+    uint8_t d, mask = 0;
+
+    /* Bit i: packet expected + 1 + i is already kept */
+    for(k = 0; k < window; k++)
+    {
+        d = (uint8_t)(held[k] - expected - 1);
+        if((held[k] >= 0) && (d < 8))
+        {
+            mask |= (uint8_t)(1 << d);
+        }
+    }
+    Send_Byte(NAK);
+    Send_Byte((uint8_t)expected);
+    Send_Byte(mask);
+}
+
+/**
+  * @brief  Receive the data packets of a file with the windowed extension
+  * @note   Up to window packets are outstanding. ACK n acknowledges all the
+  *         packets up to n, NAK n mask asks for packet n and all the
+  *         outstanding packets not kept. A packet after a gap is kept in
+  *         its slot until the missing one comes again, then the packets
+  *         are programmed in order. One NAK is sent per gap, and again when
+  *         a packet older than the last one comes while the gap is still
+  *         there: the line keeps the order, so the sender has repeated the
+  *         missing packet before it and that copy was lost too.
+  * @param  buf: YMODEM_RECV_BUF_SIZE bytes, word aligned
+  * @param  size: Size of the file
+  * @param  window: Negotiated window, 1..YMODEM_W_SIZE
+  * @retval 1: EOT received, the file is in flash
+  *        <=0: Ymodem_Receive() must return this value
+  */
+static int32_t Receive_Window(uint8_t *buf, int32_t size, uint32_t window)
+{
+    int16_t held[YMODEM_W_SIZE];
+    int32_t length[YMODEM_W_SIZE], result;
+    uint32_t k, rx, expected, errors, nak_sent, last;
+    uint8_t *packet;
+
+    for(k = 0; k < window; k++)
+    {
+        held[k] = -1;
+    }
+    expected = 1;
+    errors = 0;
+    nak_sent = 0;
+    last = 0;
+    for(;;)
+    {
+        /* A free slot, at most window - 1 packets are kept after a gap */
+        rx = Window_Find(held, window, -1);
+        packet = WINDOW_SLOT(buf, rx);
+
+        result = Receive_Packet(packet, &length[rx], NAK_TIMEOUT);
+        switch(result)
+        {
+            case 0:
+                errors = 0;
+                if(length[rx] == -1)
+                {
+                    /* Abort by sender */
+                    Program_Cancel();
+                    Send_Byte(ACK);
+                    return 0;
+                }
+                if(length[rx] == 0)
+                {
+                    /* End of transmission */
+                    if(File_End() != FLASH_COMPLETE)
+                    {
+                        Send_Byte(CA);
+                        Send_Byte(CA);
+                        return -2;
+                    }
+                    Send_Byte(ACK);
+                    return 1;
+                }
+                k = (uint8_t)(packet[PACKET_SEQNO_INDEX] - expected);
+                if(k == 0)
+                {
+                    /* In order, program it and the kept packets following it */
+                    k = rx;
+                    do
+                    {
+                        if(File_Write(WINDOW_SLOT(buf, k) + PACKET_HEADER, length[k], size) != FLASH_COMPLETE)
+                        {
+                            Send_Byte(CA);
+                            Send_Byte(CA);
+                            return -2;
+                        }
+                        YmodemStat.packets++;
+                        held[k] = -1;
+                        expected++;
+                        k = Window_Find(held, window, (int16_t)(expected & 0xff));
+                    }
+                    while(k < window);
+                    nak_sent = 0;
+                    last = 0;
+                    Send_Byte(ACK);
+                    Send_Byte((uint8_t)(expected - 1));
+                }
+                else if(k < window)
+                {
+                    /* A repeated packet: the missing one was repeated first */
+                    if(k <= last)
+                    {
+                        nak_sent = 0;
+                    }
+                    last = k;
+                    /* After a gap, keep it unless it is kept already */
+                    if(Window_Find(held, window, packet[PACKET_SEQNO_INDEX]) == window)
+                    {
+                        held[rx] = packet[PACKET_SEQNO_INDEX];
+                    }
+                    if(nak_sent == 0)
+                    {
+                        Window_Nak(held, window, expected);
+                        nak_sent = 1;
+                    }
+                }
+                else
+                {
+                    /* Repeated packet, already in flash */
+                    Send_Byte(ACK);
+                    Send_Byte((uint8_t)(expected - 1));
+                }
+                break;
+            case 1:
+                Program_Cancel();
+                Send_Byte(CA);
+                Send_Byte(CA);
+                return -3;
+            default:
+                if(result == -2)
+                {
+                    YmodemStat.crc_errors++;
+                }
+                if(++errors > MAX_ERRORS)
+                {
+                    Program_Cancel();
+                    Send_Byte(CA);
+                    Send_Byte(CA);
+                    return 0;
+                }
+                if(result != -2)
+                {
+                    Receive_Purge();
+                }
+                Window_Nak(held, window, expected);
+                nak_sent = 1;
+                break;
+        }
+    }
+}
+#endif
+
 /**
   * @brief  Receive a file using the ymodem protocol
-  * @param  buf: Address of the first byte
+  * @note   A data packet is acknowledged as soon as it is validated and is
+  *         collected by flash page. A full page is programmed while the
+  *         next one is received, unless the flash holds it already.
+  *         A programming error is reported at a later ACK.
+  *         With YMODEM_G_EN the receiver asks for Ymodem-G ('G') first and
+  *         the packets are not acknowledged, any error cancels the stream.
+  *         With YMODEM_W_EN a sender offering a window in the filename
+  *         packet gets the data packets through Receive_Window().
+  *         With YMODEM_LZ_EN a file named *YMODEM_LZ_SUFFIX is decompressed
+  *         packet by packet, the size of the file is the compressed size.
+  * @param  buf: YMODEM_RECV_BUF_SIZE bytes, word aligned
   * @retval The size of the file
   */
 int32_t Ymodem_Receive(uint8_t *buf)
 {
-    uint8_t packet_data[PACKET_1KB_SIZE + PACKET_OVERHEAD], file_size[FILE_SIZE_LENGTH], *file_ptr, *buf_ptr;
-    int32_t i, j, packet_length, session_done, file_done, packets_received, errors, session_begin, size = 0;
+    uint8_t file_size[FILE_SIZE_LENGTH], *file_ptr, *packet_data;
+    int32_t i, packet_length, session_done, file_done, packets_received, errors, session_begin, size = 0;
+    uint32_t g_tries, stream_error;
+#if (YMODEM_W_EN)
+    uint32_t window;
+#endif
+    uint8_t mode;
 
     /* Initialize FlashDestination variable */
-    FlashDestination = ApplicationAddress;
-
-    Send_Byte(CRC16);
+#if (IAP_DUAL_SLOT)
+    /* The slot not booted, the running image stays valid */
+    FlashBase = iap_imageTarget();
+#else
+    FlashBase = ApplicationAddress;
+#endif
+    FlashDestination = FlashBase;
+
+    /* The payload of a packet starts on a word boundary */
+    packet_data = buf + PACKET_ALIGN_OFFSET;
+    Program_Cancel();
+    memset(&YmodemStat, 0, sizeof(YmodemStat));
+
+    /* Ask for Ymodem-G first, classic Ymodem if the sender does not answer */
+#if (YMODEM_G_EN)
+    mode = CRCG;
+#else
+    mode = CRC16;
+#endif
+    g_tries = 0;
+    stream_error = 0;
+    Send_Byte(mode);
     for(session_done = 0, errors = 0, session_begin = 0; ;)
     {
-        for(packets_received = 0, file_done = 0, buf_ptr = buf; ;)
+        for(packets_received = 0, file_done = 0; ;)
         {
             switch(Receive_Packet(packet_data, &packet_length, NAK_TIMEOUT))
             {
@@ -216,18 +893,35 @@ int32_t Ymodem_Receive(uint8_t *buf)
                     {
                         /* Abort by sender */
                         case - 1://ʧ
+                            Program_Cancel();
                             Send_Byte(ACK);
                             return 0;
                         /* End of transmission */
                         case 0://ļͽ
+                            if(File_End() != FLASH_COMPLETE)
+                            {
+                                /* End session */
+                                Send_Byte(CA);
+                                Send_Byte(CA);
+                                return -2;
+                            }
                             Send_Byte(ACK);
+                            /* Ask for the next file at once */
+                            Send_Byte(mode);
                             file_done = 1;
                             break;
                         /* Normal packet */
                         default://ճɹ
                             if((packet_data[PACKET_SEQNO_INDEX] & 0xff) != (packets_received & 0xff))
                             {
-                                Send_Byte(NAK);
+                                if((mode == CRCG) && (session_begin > 0))
+                                {
+                                    stream_error = 1;
+                                }
+                                else
+                                {
+                                    Send_Byte(NAK);
+                                }
                             }
                             else
                             {
@@ -259,34 +953,43 @@ int32_t Ymodem_Receive(uint8_t *buf)
                                             return -1;
                                         }
 
-                                        /* Erase the needed pages where the user application will be loaded */
-                                        /* Define the number of page to be erased */
+                                        /* No bulk erase here: the data is collected by page and
+                                           a page is only erased and programmed when it differs
+                                           from the flash, see Page_Write() */
+#if (YMODEM_W_EN)
+                                        window = Window_Parse(packet_data + PACKET_HEADER, packet_length);
+#endif
+#if (YMODEM_G_RESUME)
+                                        ResumeStart = FlashDestination;
+#endif
+                                        File_Begin();
+#if (YMODEM_W_EN)
+                                        if(window != 0)
                                         {
-                                            uint32_t pagenumber, i;
-
-                                            if((size % PAGE_SIZE) != 0)
-                                            {
-                                                pagenumber = (size / PAGE_SIZE) + 1;
-                                            }
-                                            else
+                                            /* Accept the window, the data packets are received there */
+                                            Send_Byte(ACK);
+                                            Send_Byte(YMODEM_W_MAGIC);
+                                            Send_Byte((uint8_t)window);
+                                            i = Receive_Window(buf, size, window);
+                                            if(i <= 0)
                                             {
-                                                pagenumber = size / PAGE_SIZE;
-                                            }
-                                            FLASH_Unlock();
-                                            for(i = 0; i < pagenumber; i++)
-                                            {
-                                                if(FLASH_ErasePage(FlashDestination + (PageSize * i)) != FLASH_COMPLETE)
-                                                {
-                                                    /* End session */
-                                                    Send_Byte(CA);
-                                                    Send_Byte(CA);
-                                                    return -1;
-                                                    //Erase failed
-                                                }
+                                                return i;
                                             }
+                                            Send_Byte(mode);
+                                            file_done = 1;
+                                        }
+                                        else
+#endif
+                                        /* Ymodem-G does not acknowledge the filename packet */
+                                        if(mode == CRC16)
+                                        {
+                                            Send_Byte(ACK);
+                                            Send_Byte(mode);
+                                        }
+                                        else
+                                        {
+                                            Send_Byte(mode);
                                         }
-                                        Send_Byte(ACK);
-                                        Send_Byte(CRC16);
                                     }
                                     /* Filename packet is empty, end session */
                                     else
@@ -300,25 +1003,19 @@ int32_t Ymodem_Receive(uint8_t *buf)
                                 /* Data packet */
                                 else//ļϢ֮ʼ
                                 {
-                                    memcpy(buf_ptr, packet_data + PACKET_HEADER, packet_length);
-                                    RamSource = (uint32_t)buf;
-                                    for(j = 0; (j < packet_length) && (FlashDestination <  ApplicationAddress + size); j += 4)
+                                    /* An error of the page programmed before is reported instead of the ACK */
+                                    if(File_Write(packet_data + PACKET_HEADER, packet_length, size) != FLASH_COMPLETE)
                                     {
-                                        /* Program the data received into STM32F10x Flash */
-                                        FLASH_Unlock();
-                                        FLASH_ProgramWord(FlashDestination, *(uint32_t*)RamSource);
-                                        FLASH_Lock();
-                                        if(*(uint32_t*)FlashDestination != *(uint32_t*)RamSource)
-                                        {
-                                            /* End session */
-                                            Send_Byte(CA);
-                                            Send_Byte(CA);
-                                            return -2;
-                                        }
-                                        FlashDestination += 4;
-                                        RamSource += 4;
+                                        /* End session */
+                                        Send_Byte(CA);
+                                        Send_Byte(CA);
+                                        return -2;
+                                    }
+                                    if(mode == CRC16)
+                                    {
+                                        Send_Byte(ACK);
                                     }
-                                    Send_Byte(ACK);
+                                    YmodemStat.packets++;
                                 }
                                 packets_received ++;
                                 session_begin = 1;
@@ -326,23 +1023,84 @@ int32_t Ymodem_Receive(uint8_t *buf)
                     }
                     break;
                 case 1://û'a''A'
+                    Program_Cancel();
                     Send_Byte(CA);
                     Send_Byte(CA);
                     return -3;
+                case -2:
+                    /* Corrupted payload, ask the sender to repeat it */
+                    YmodemStat.crc_errors++;
+                    if((mode == CRCG) && (session_begin > 0))
+                    {
+                        stream_error = 1;
+                        break;
+                    }
+                    if(session_begin > 0)
+                    {
+                        errors ++;
+                    }
+                    if(errors > MAX_ERRORS)
+                    {
+                        Program_Cancel();
+                        Send_Byte(CA);
+                        Send_Byte(CA);
+                        return 0;
+                    }
+                    Send_Byte(NAK);
+                    break;
                 default://
+                    if((mode == CRCG) && (session_begin > 0))
+                    {
+                        stream_error = 1;
+                        break;
+                    }
                     if(session_begin > 0)
                     {
                         errors ++;
                     }
+                    else if((mode == CRCG) && (++g_tries >= YMODEM_G_TRIES))
+                    {
+                        /* The sender does not know Ymodem-G */
+                        mode = CRC16;
+                    }
                     if(errors > MAX_ERRORS)
                     {
+                        Program_Cancel();
                         Send_Byte(CA);
                         Send_Byte(CA);
                         return 0;
                     }
-                    Send_Byte(CRC16);//Уֵ
+                    /* Let the rest of a broken packet go by before asking again */
+                    Receive_Purge();
+                    Send_Byte(mode);//Уֵ
                     break;
             }
+            if(stream_error != 0)
+            {
+                /* A Ymodem-G sender can not repeat a packet, cancel the stream */
+                stream_error = 0;
+                Send_Byte(CA);
+                Send_Byte(CA);
+#if (YMODEM_G_RESUME)
+                /* Keep what is in flash and wait for the file again in classic mode,
+                   the pages programmed already compare equal and are skipped */
+                if(Page_Flush() != FLASH_COMPLETE)
+                {
+                    return -2;
+                }
+                FlashDestination = ResumeStart;
+                File_Begin();
+                packets_received = 0;
+                session_begin = 0;
+                errors = 0;
+                mode = CRC16;
+                Receive_Purge();
+                Send_Byte(mode);
+#else
+                Program_Cancel();
+                return 0;
+#endif
+            }
             if(file_done != 0)
             {
                 break;
@@ -374,7 +1132,7 @@ int32_t Ymodem_CheckResponse(uint8_t c)
 void Ymodem_PrepareIntialPacket(uint8_t *data, const uint8_t* fileName, uint32_t *length)
 {
     uint16_t i, j;
-    uint8_t file_ptr[10];
+    uint8_t file_ptr[11];
 
     /* Make first three packet */
     data[0] = SOH;
@@ -395,6 +1153,13 @@ void Ymodem_PrepareIntialPacket(uint8_t *data, const uint8_t* fileName, uint32_t
         data[i++] = file_ptr[j++];
     }
 
+#if (YMODEM_W_EN)
+    /* Offer the windowed extension after the NUL of the size field */
+    data[i++] = 0x00;
+    data[i++] = YMODEM_W_MAGIC;
+    data[i++] = YMODEM_W_SIZE;
+#endif
+
     for(j = i; j < PACKET_128B_SIZE + PACKET_HEADER; j++)
     {
         data[j] = 0;
@@ -440,30 +1205,6 @@ void Ymodem_PreparePacket(uint8_t *SourceBuf, uint8_t *data, uint8_t pktNo, uint
     }
 }
 
-/**
-  * @brief  Update CRC16 for input byte
-  * @param  CRC input value
-  * @param  input byte
-   * @retval None
-  */
-uint16_t UpdateCRC16(uint16_t crcIn, uint8_t byte)
-{
-    uint32_t crc = crcIn;
-    uint32_t in = byte | 0x100;
-    do
-    {
-        crc <<= 1;
-        in <<= 1;
-        if(in & 0x100)
-            ++crc;
-        if(crc & 0x10000)
-            crc ^= 0x1021;
-    }
-    while(!(in & 0x10000));
-    return crc & 0xffffu;
-}
-
-
 /**
   * @brief  Cal CRC16 for YModem Packet
   * @param  data
@@ -472,14 +1213,7 @@ uint16_t UpdateCRC16(uint16_t crcIn, uint8_t byte)
   */
 uint16_t Cal_CRC16(const uint8_t* data, uint32_t size)
 {
-    uint32_t crc = 0;
-    const uint8_t* dataEnd = data + size;
-    while(data < dataEnd)
-        crc = UpdateCRC16(crc, *data++);
-
-    crc = UpdateCRC16(crc, 0);
-    crc = UpdateCRC16(crc, 0);
-    return crc & 0xffffu;
+    return crc16_calc(0, data, size);
 }
 
 /**
@@ -514,6 +1248,126 @@ void Ymodem_SendPacket(uint8_t *data, uint16_t length)
     }
 }
 
+#if (YMODEM_W_EN)
+/**
+  * @brief  Send one data packet of the windowed extension
+  * @note   All the packets are 1 KB, the last one is padded, so any packet
+  *         can be built again from its number.
+  * @param  data: Packet buffer
+  * @param  buf: File data
+  * @param  sizeFile: Size of the file
+  * @param  pktNo: Packet number from 1
+  * @retval None
+  */
+static void Window_SendPacket(uint8_t *data, const uint8_t *buf, uint32_t sizeFile, uint32_t pktNo)
+{
+    uint32_t i, offset, size;
+    uint16_t tempCRC;
+
+    offset = (pktNo - 1) * PACKET_1KB_SIZE;
+    size = sizeFile - offset;
+    if(size > PACKET_1KB_SIZE)
+    {
+        size = PACKET_1KB_SIZE;
+    }
+    data[0] = STX;
+    data[1] = (uint8_t)pktNo;
+    data[2] = (uint8_t)(~pktNo);
+    for(i = 0; i < PACKET_1KB_SIZE; i++)
+    {
+        data[PACKET_HEADER + i] = (i < size) ? buf[offset + i] : 0x1A;
+    }
+    Ymodem_SendPacket(data, PACKET_1KB_SIZE + PACKET_HEADER);
+    tempCRC = Cal_CRC16(&data[PACKET_HEADER], PACKET_1KB_SIZE);
+    Send_Byte(tempCRC >> 8);
+    Send_Byte(tempCRC & 0xFF);
+}
+
+/**
+  * @brief  Send the data packets of a file with the windowed extension
+  * @note   Keeps up to window packets outstanding, see Receive_Window().
+  * @param  data: Packet buffer
+  * @param  buf: File data
+  * @param  sizeFile: Size of the file
+  * @param  window: Window accepted by the receiver
+  * @retval 0: All the packets acknowledged
+  *        >0: Errors
+  */
+static uint8_t Transmit_Window(uint8_t *data, const uint8_t *buf, uint32_t sizeFile, uint32_t window)
+{
+    uint32_t total, base, next, pktNo, i, errors;
+    uint8_t c, seq, mask;
+
+    total = (sizeFile + PACKET_1KB_SIZE - 1) / PACKET_1KB_SIZE;
+    errors = 0;
+    for(base = 1, next = 1; base <= total;)
+    {
+        /* Fill the window */
+        for(; (next < base + window) && (next <= total); next++)
+        {
+            Window_SendPacket(data, buf, sizeFile, next);
+        }
+
+        if(Receive_Byte(&c, ACK_TIMEOUT) != 0)
+        {
+            /* No answer, repeat the oldest packet */
+            if(++errors >= 0x0A)
+            {
+                return errors;
+            }
+            Window_SendPacket(data, buf, sizeFile, base);
+            continue;
+        }
+        switch(c)
+        {
+            case ACK:
+                /* All the packets up to seq are received */
+                if(Receive_Byte(&seq, BYTE_TIMEOUT) == 0)
+                {
+                    pktNo = base + (uint8_t)(seq - base);
+                    if(pktNo < next)
+                    {
+                        base = pktNo + 1;
+                        errors = 0;
+                    }
+                }
+                break;
+            case NAK:
+                /* Packet seq is missing, mask tells the ones kept after it */
+                if((Receive_Byte(&seq, BYTE_TIMEOUT) == 0) && (Receive_Byte(&mask, BYTE_TIMEOUT) == 0))
+                {
+                    pktNo = base + (uint8_t)(seq - base);
+                    if(pktNo >= next)
+                    {
+                        break;
+                    }
+                    if(++errors >= 0x0A)
+                    {
+                        return errors;
+                    }
+                    base = pktNo;
+                    Window_SendPacket(data, buf, sizeFile, pktNo);
+                    /* And all the outstanding ones not kept, lost or not
+                       arrived yet, the receiver drops the repeated ones */
+                    for(i = 0; pktNo + 1 + i < next; i++)
+                    {
+                        if((mask & (1 << i)) == 0)
+                        {
+                            Window_SendPacket(data, buf, sizeFile, pktNo + 1 + i);
+                        }
+                    }
+                }
+                break;
+            case CA:
+                return 0xFF;
+            default:
+                break;
+        }
+    }
+    return 0;
+}
+#endif
+
 /**
   * @brief  Transmit a file using the ymodem protocol
   * @param  buf: Address of the first byte
@@ -527,10 +1381,12 @@ uint8_t Ymodem_Transmit(uint8_t *buf, const uint8_t* sendFileName, uint32_t size
     uint8_t *buf_ptr, tempCheckSum ;
     uint16_t tempCRC, blkNumber;
     uint8_t receivedC[2], CRC16_F = 0, i;
-    uint32_t errors, ackReceived, size = 0, pktSize;
+    uint32_t errors, ackReceived, size = 0, pktSize, streaming, window;
 
     errors = 0;
     ackReceived = 0;
+    streaming = 0;
+    window = 0;
     for(i = 0; i < (FILE_NAME_LENGTH - 1); i++)
     {
         FileName[i] = sendFileName[i];
@@ -540,6 +1396,16 @@ uint8_t Ymodem_Transmit(uint8_t *buf, const uint8_t* sendFileName, uint32_t size
     /* Prepare first block */
     Ymodem_PrepareIntialPacket(&packet_data[0], FileName, &sizeFile);
 
+    /* Wait for the receiver to ask for the first block */
+    while((Receive_Byte(&receivedC[0], ACK_TIMEOUT) != 0) || ((receivedC[0] != CRC16) && (receivedC[0] != CRCG)))
+    {
+        if(++errors >= 0x0A)
+        {
+            return errors;
+        }
+    }
+    errors = 0;
+
     do
     {
         /* Send Packet */
@@ -558,12 +1424,24 @@ uint8_t Ymodem_Transmit(uint8_t *buf, const uint8_t* sendFileName, uint32_t size
         }
 
         /* Wait for Ack and 'C' */
-        if(Receive_Byte(&receivedC[0], 10000) == 0)
+        if(Receive_Byte(&receivedC[0], ACK_TIMEOUT) == 0)
         {
             if(receivedC[0] == ACK)
             {
                 /* Packet transfered correctly */
                 ackReceived = 1;
+                /* Then 'C', or 'W' and the window for the windowed extension */
+                if((Receive_Byte(&receivedC[0], ACK_TIMEOUT) == 0) && (receivedC[0] == YMODEM_W_MAGIC) &&
+                   (Receive_Byte(&receivedC[1], BYTE_TIMEOUT) == 0))
+                {
+                    window = receivedC[1];
+                }
+            }
+            else if(receivedC[0] == CRCG)
+            {
+                /* Ymodem-G receiver, stream the data packets without ACK */
+                ackReceived = 1;
+                streaming = 1;
             }
         }
         else
@@ -580,6 +1458,18 @@ uint8_t Ymodem_Transmit(uint8_t *buf, const uint8_t* sendFileName, uint32_t size
     buf_ptr = buf;
     size = sizeFile;
     blkNumber = 0x01;
+
+#if (YMODEM_W_EN)
+    if(window != 0)
+    {
+        errors = Transmit_Window(packet_data, buf, sizeFile, (window < YMODEM_W_SIZE) ? window : YMODEM_W_SIZE);
+        if(errors != 0)
+        {
+            return errors;
+        }
+        size = 0;
+    }
+#endif
     /* Here 1024 bytes package is used to send the packets */
 
 
@@ -618,8 +1508,14 @@ uint8_t Ymodem_Transmit(uint8_t *buf, const uint8_t* sendFileName, uint32_t size
                 Send_Byte(tempCheckSum);
             }
 
+            /* A Ymodem-G receiver only answers to cancel */
+            if((streaming != 0) && (Receive_Byte(&receivedC[0], 0) == 0) && (receivedC[0] == CA))
+            {
+                return 0xFF;
+            }
+
             /* Wait for Ack */
-            if((Receive_Byte(&receivedC[0], 100000) == 0)  && (receivedC[0] == ACK))
+            if((streaming != 0) || ((Receive_Byte(&receivedC[0], ACK_TIMEOUT) == 0)  && (receivedC[0] == ACK)))
             {
                 ackReceived = 1;
                 if(size > pktSize)
@@ -655,6 +1551,11 @@ uint8_t Ymodem_Transmit(uint8_t *buf, const uint8_t* sendFileName, uint32_t size
         }
 
     }
+    if((streaming != 0) || (window != 0))
+    {
+        /* Drop the 'G' or repeated ACKs left by the receiver, the EOT must be acknowledged */
+        Receive_Purge();
+    }
     ackReceived = 0;
     receivedC[0] = 0x00;
     errors = 0;
@@ -663,7 +1564,7 @@ uint8_t Ymodem_Transmit(uint8_t *buf, const uint8_t* sendFileName, uint32_t size
         Send_Byte(EOT);
         /* Send (EOT); */
         /* Wait for Ack */
-        if((Receive_Byte(&receivedC[0], 10000) == 0)  && receivedC[0] == ACK)
+        if((Receive_Byte(&receivedC[0], ACK_TIMEOUT) == 0)  && receivedC[0] == ACK)
         {
             ackReceived = 1;
         }
@@ -703,7 +1604,7 @@ uint8_t Ymodem_Transmit(uint8_t *buf, const uint8_t* sendFileName, uint32_t size
         Send_Byte(tempCRC & 0xFF);
 
         /* Wait for Ack and 'C' */
-        if(Receive_Byte(&receivedC[0], 10000) == 0)
+        if(Receive_Byte(&receivedC[0], ACK_TIMEOUT) == 0)
         {
             if(receivedC[0] == ACK)
             {
@@ -729,7 +1630,7 @@ uint8_t Ymodem_Transmit(uint8_t *buf, const uint8_t* sendFileName, uint32_t size
         Send_Byte(EOT);
         /* Send (EOT); */
         /* Wait for Ack */
-        if((Receive_Byte(&receivedC[0], 10000) == 0)  && receivedC[0] == ACK)
+        if((Receive_Byte(&receivedC[0], ACK_TIMEOUT) == 0)  && receivedC[0] == ACK)
         {
             ackReceived = 1;
         }
@@ -773,6 +1674,7 @@ static void Int2Str(uint8_t *p_str, uint32_t intnum)
             status++;
         }
     }
+    p_str[pos] = '\0';
 }
 
 /**
@@ -27,6 +27,15 @@
 /* Includes ------------------------------------------------------------------*/
 
 /* Exported types ------------------------------------------------------------*/
+typedef struct
+{
+    uint32_t packets;       /* data packets accepted in the session */
+    uint32_t crc_errors;    /* packets rejected by the CRC16 */
+    uint32_t blank_pages;   /* pages programmed without erase */
+    uint32_t skipped_pages; /* pages identical to the flash, not programmed */
+    uint32_t rewritten_pages;   /* pages failing the verification, programmed again */
+} Ymodem_StatTypeDef;
+
 /* Exported constants --------------------------------------------------------*/
 #define PACKET_SEQNO_INDEX      (1)
 #define PACKET_SEQNO_COMP_INDEX (2)
@@ -43,6 +52,14 @@
 #define PACKET_512B_SIZE        (512)
 #define PACKET_1KB_SIZE         (1024)
 #define PACKET_2KB_SIZE		    (2048)
+#define PACKET_MAX_SIZE         PACKET_2KB_SIZE
+
+/* Ymodem_Receive() keeps one packet, or YMODEM_W_SIZE with the windowed
+   extension, the payload of each one on a word boundary. A payload is
+   copied to the page buffer of ymodem.c at once, the slot is free again */
+#define PACKET_ALIGN_OFFSET     (1)
+#define PACKET_SLOT_SIZE        ((PACKET_ALIGN_OFFSET + PACKET_MAX_SIZE + PACKET_OVERHEAD + 3) & ~3)
+#define YMODEM_RECV_BUF_SIZE    (PACKET_SLOT_SIZE * ((YMODEM_W_EN) ? YMODEM_W_SIZE : 1))
 
 #define FILE_NAME_LENGTH        (256)
 #define FILE_SIZE_LENGTH        (16)
@@ -64,15 +81,22 @@
 #define NAK                     (0x15)  /* negative acknowledge */
 #define CA                      (0x18)  /* two of these in succession aborts transfer */
 #define CRC16                   (0x43)  /* 'C' == 0x43, request 16-bit CRC */
+#define CRCG                    (0x47)  /* 'G' == 0x47, request Ymodem-G streaming */
+#define YMODEM_W_MAGIC          (0x57)  /* 'W' == 0x57, windowed extension offer/answer */
 
 #define ABORT1                  (0x41)  /* 'A' == 0x41, abort by user */
 #define ABORT2                  (0x61)  /* 'a' == 0x61, abort by user */
 
-#define NAK_TIMEOUT             (0x100000)
+/* Timeouts in ms */
+#define NAK_TIMEOUT             (1000)  /* first byte of a packet, then 'C' again */
+#define BYTE_TIMEOUT            (100)   /* between the bytes of a packet */
+#define ACK_TIMEOUT             (1000)  /* answer of the receiver to a packet */
 #define MAX_ERRORS              (5)
+#define YMODEM_G_TRIES          (3)     /* 'G' sent before falling back to 'C' */
 
 extern uint32_t FlashDestination;
 extern uint8_t file_name[FILE_NAME_LENGTH];
+extern Ymodem_StatTypeDef YmodemStat;
 
 /* Exported macro ------------------------------------------------------------*/
 #define IS_CAP_LETTER(c)    (((c) >= 'A') && ((c) <= 'F'))
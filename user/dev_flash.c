@@ -10,39 +10,1270 @@
  ******************************************************************************
  */
 
+#include <string.h>
 #include "stm32f10x_flash.h"
 #include "dev_flash.h"
 
 
+#if (FLASH_CACHE_PAGES)
+typedef struct
+{
+    uint32_t addr;                  /* page address, 0: line unused */
+    uint32_t dirty;                 /* data differs from the flash */
+    uint32_t used;                  /* FlashCacheTick at the last access */
+    uint32_t data[PAGE_SIZE / 4];
+} FlashCache_TypeDef;
+
+static FlashCache_TypeDef FlashCache[FLASH_CACHE_PAGES];
+static uint32_t FlashCacheTick;
+
+typedef struct
+{
+    const uint8_t *pBuff;           /* data not in the cache yet */
+    uint32_t addr;
+    uint32_t size;
+    FlashCache_TypeDef *line;       /* line being written back, 0: none */
+    uint32_t offset;                /* next byte of the line to program */
+    uint32_t erasing;               /* the page of the line is being erased */
+} FlashWrite_TypeDef;
+
+static FlashWrite_TypeDef FlashWrite;
+#else
 static uint16_t FlashTemp[PAGE_SIZE / 2]; //Up to 2K bytes
+static int32_t FlashWriteStatus = FLASH_ASYNC_DONE;
+#endif
+
+typedef struct
+{
+    volatile int32_t status;        /* FLASH_ASYNC_xxx */
+    __IO uint16_t *pFlash;          /* next half word to program */
+    const uint16_t *pBuffer;
+    uint32_t count;                 /* half words left after pFlash */
+    dev_flashCallback_t callback;
+} FlashAsync_TypeDef;
+
+static FlashAsync_TypeDef FlashAsync = {FLASH_ASYNC_DONE, 0, 0, 0, 0};
+static uint32_t FlashHold;      /* a dev_flashWriteStep() job keeps the flash unlocked */
+
+/* Device behind all the dev_flash functions */
+static const dev_flashOps_t *FlashBackend = &dev_flashInternal;
+
+#if (FLASH_PROFILE_EN)
+static uint32_t ProfileCycles;  /* CPU cycles spent in dev_flashProgram() */
+static uint32_t ProfileBytes;   /* bytes programmed meanwhile, not the skipped ones */
+static uint32_t ProfileErases;  /* pages erased by dev_flashWrite() and dev_flashEraseRange() */
+static uint32_t ProfileReadCycles, ProfileReadBytes;        /* in dev_flashRead() */
+static uint32_t ProfileCompareCycles, ProfileCompareBytes;  /* in dev_flashCompare() */
+#endif
+
+/**
+ ****************************************************************************
+ * @brief  Unlock the FLASH registers for an operation.
+ * @author lizdDong
+ * @note   The keys are only written when locked, a key sequence while
+ *         unlocked would lock the FLASH_CR until the next reset.
+ * @param  None
+ * @retval None
+ ****************************************************************************
+*/
+static void dev_flashUnlock(void)
+{
+    if((FLASH->CR & FLASH_CR_LOCK) != 0)
+    {
+        FLASH_Unlock();
+    }
+}
+
+/**
+ ****************************************************************************
+ * @brief  Lock the FLASH registers after an operation.
+ * @author lizdDong
+ * @note   Left unlocked while a dev_flashWriteStep() job runs, its steps
+ *         unlock once for the whole job.
+ * @param  None
+ * @retval None
+ ****************************************************************************
+*/
+RAM_FUNC static void dev_flashLock(void)
+{
+    if(FlashHold == 0)
+    {
+        FLASH->CR |= FLASH_CR_LOCK;
+    }
+}
+
+/**
+ ****************************************************************************
+ * @brief  Program the internal flash, there is no check writing.
+ * @author lizdDong
+ * @note   The flash is unlocked for the time of the call, see
+ *         dev_flashLock(). With
+ *         FLASH_FAST_PROGRAM the PG bit is set once for the whole range,
+ *         each half word only waits for BSY and the error flags are checked
+ *         at the end. The half words that already hold the data are not
+ *         programmed.
+ * @param  addr: The starting address to be written.(The address must be a multiple of two)
+ * @param  pBuff: The pointer to the data.(The address must be a multiple of two)
+ * @param  size: The number of byte written(8bit), The number should beat to a multiple of two.
+ * @retval 0: Programmed
+ *        -1: PGERR or WRPRTERR
+ ****************************************************************************
+*/
+RAM_FUNC static int32_t dev_flashInternalProgram(uint32_t addr, const uint8_t *pBuff, uint32_t size)
+{
+    __IO uint16_t *pFlash = (__IO uint16_t *)addr;
+    const uint16_t *pBuffer = (const uint16_t *)pBuff;
+    uint32_t i, err = 0, programmed = 0;
+#if (FLASH_PROFILE_EN)
+    uint32_t start = DWT->CYCCNT;
+#endif
+
+    dev_flashUnlock();
+#if (FLASH_FAST_PROGRAM)
+    FLASH->SR = FLASH_SR_EOP | FLASH_SR_PGERR | FLASH_SR_WRPRTERR;
+    FLASH->CR |= FLASH_CR_PG;
+    for(i = 0; i < size / 2; i++)
+    {
+        if(pFlash[i] != pBuffer[i])
+        {
+            pFlash[i] = pBuffer[i];
+            programmed++;
+            while((FLASH->SR & FLASH_SR_BSY) != 0);
+        }
+    }
+    FLASH->CR &= ~FLASH_CR_PG;
+    err = FLASH->SR & (FLASH_SR_PGERR | FLASH_SR_WRPRTERR);
+    FLASH->SR = FLASH_SR_EOP | FLASH_SR_PGERR | FLASH_SR_WRPRTERR;
+#else
+    for(i = 0; i < size / 2; i++)
+    {
+        if(pFlash[i] == pBuffer[i])
+        {
+            continue;
+        }
+        programmed++;
+        if(FLASH_ProgramHalfWord(addr + i * 2, pBuffer[i]) != FLASH_COMPLETE)
+        {
+            err = 1;
+            break;
+        }
+    }
+#endif
+
+    dev_flashLock();
+
+#if (FLASH_PROFILE_EN)
+    ProfileCycles += DWT->CYCCNT - start;
+    ProfileBytes += programmed * 2;
+#else
+    (void)programmed;
+#endif
+    return (err == 0) ? 0 : -1;
+}
+
+#if (FLASH_PROFILE_EN)
+/**
+ ****************************************************************************
+ * @brief  Start counting the cycles spent programming.
+ * @author lizdDong
+ * @note   Enables the DWT cycle counter.
+ * @param  None
+ * @retval None
+ ****************************************************************************
+*/
+void dev_flashProfileReset(void)
+{
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CYCCNT = 0;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+    ProfileCycles = 0;
+    ProfileBytes = 0;
+    ProfileErases = 0;
+    ProfileReadCycles = 0;
+    ProfileReadBytes = 0;
+    ProfileCompareCycles = 0;
+    ProfileCompareBytes = 0;
+}
+
+/**
+ ****************************************************************************
+ * @brief  Get the pages erased by dev_flashWrite() since dev_flashProfileReset().
+ * @author lizdDong
+ * @note   None
+ * @param  None
+ * @retval The number of erases
+ ****************************************************************************
+*/
+uint32_t dev_flashEraseCount(void)
+{
+    return ProfileErases;
+}
+
+/**
+ ****************************************************************************
+ * @brief  Get the cycles spent per programmed KB since dev_flashProfileReset().
+ * @author lizdDong
+ * @note   Build once with FLASH_FAST_PROGRAM 0 to get the StdPeriph figure.
+ *         Only the half words programmed count as bytes, the time spent
+ *         comparing the skipped ones is in the cycles.
+ * @param  None
+ * @retval Cycles per KB, 0 if nothing was programmed
+ ****************************************************************************
+*/
+uint32_t dev_flashCyclesPerKB(void)
+{
+    if(ProfileBytes == 0)
+    {
+        return 0;
+    }
+    return (uint32_t)(((uint64_t)ProfileCycles * 1024) / ProfileBytes);
+}
+
+/**
+ ****************************************************************************
+ * @brief  Get the cycles spent per KB read since dev_flashProfileReset().
+ * @author lizdDong
+ * @note   The copy out of the cached pages is in the cycles.
+ * @param  None
+ * @retval Cycles per KB, 0 if nothing was read
+ ****************************************************************************
+*/
+uint32_t dev_flashReadCyclesPerKB(void)
+{
+    if(ProfileReadBytes == 0)
+    {
+        return 0;
+    }
+    return (uint32_t)(((uint64_t)ProfileReadCycles * 1024) / ProfileReadBytes);
+}
+
+/**
+ ****************************************************************************
+ * @brief  Get the cycles spent per KB compared since dev_flashProfileReset().
+ * @author lizdDong
+ * @note   A compare stops at the first half word needing an erase, the
+ *         bytes count whole all the same.
+ * @param  None
+ * @retval Cycles per KB, 0 if nothing was compared
+ ****************************************************************************
+*/
+uint32_t dev_flashCompareCyclesPerKB(void)
+{
+    if(ProfileCompareBytes == 0)
+    {
+        return 0;
+    }
+    return (uint32_t)(((uint64_t)ProfileCompareCycles * 1024) / ProfileCompareBytes);
+}
+#endif
+
+/**
+ ****************************************************************************
+ * @brief  Erase a page of the internal flash.
+ * @author lizdDong
+ * @note   The flash is unlocked for the time of the call, see
+ *         dev_flashLock(). Runs from SRAM
+ *         with FLASH_RAM_FUNC_EN, the interrupts in SRAM are served while
+ *         waiting for BSY.
+ * @param  addr: An address in the page.
+ * @retval 0: Erased
+ *        -1: PGERR or WRPRTERR
+ ****************************************************************************
+*/
+RAM_FUNC static int32_t dev_flashInternalErase(uint32_t addr)
+{
+    uint32_t err;
+
+    dev_flashUnlock();
+    FLASH->SR = FLASH_SR_EOP | FLASH_SR_PGERR | FLASH_SR_WRPRTERR;
+    FLASH->CR |= FLASH_CR_PER;
+    FLASH->AR = addr;
+    FLASH->CR |= FLASH_CR_STRT;
+    while((FLASH->SR & FLASH_SR_BSY) != 0);
+    FLASH->CR &= ~FLASH_CR_PER;
+    err = FLASH->SR & (FLASH_SR_PGERR | FLASH_SR_WRPRTERR);
+    FLASH->SR = FLASH_SR_EOP | FLASH_SR_PGERR | FLASH_SR_WRPRTERR;
+    dev_flashLock();
+    return (err == 0) ? 0 : -1;
+}
+
+/**
+ ****************************************************************************
+ * @brief  Erase a page of the backend.
+ * @author lizdDong
+ * @note   The internal flash unlocks itself for the time of the call.
+ * @param  addr: An address in the page.
+ * @retval 0: Erased
+ *        -1: Erase error
+ ****************************************************************************
+*/
+int32_t dev_flashErasePage(uint32_t addr)
+{
+    return FlashBackend->erase(addr);
+}
+
+/**
+ ****************************************************************************
+ * @brief  Program data in the backend, there is no check writing.
+ * @author lizdDong
+ * @note   The internal flash unlocks itself for the time of the call. The
+ *         half words that already hold the data are not programmed.
+ * @param  addr: The starting address to be written.(The address must be a multiple of two)
+ * @param  pBuff: The pointer to the data.(The address must be a multiple of two)
+ * @param  size: The number of byte written(8bit), The number should beat to a multiple of two.
+ * @retval 0: Programmed
+ *        -1: Program error
+ ****************************************************************************
+*/
+int32_t dev_flashProgram(uint32_t addr, const uint8_t *pBuff, uint32_t size)
+{
+    return FlashBackend->program(addr, pBuff, size);
+}
+
+/**
+ ****************************************************************************
+ * @brief  End the asynchronous operation.
+ * @author lizdDong
+ * @note   None
+ * @param  status: FLASH_ASYNC_DONE or FLASH_ASYNC_ERROR
+ * @retval None
+ ****************************************************************************
+*/
+RAM_FUNC static void dev_flashAsyncEnd(int32_t status)
+{
+    FlashAsync.status = status;
+    if(FlashAsync.callback != 0)
+    {
+        FlashAsync.callback(status);
+    }
+}
+
+/**
+ ****************************************************************************
+ * @brief  End the asynchronous operation of the internal flash.
+ * @author lizdDong
+ * @note   Called from FLASH_IRQHandler(). The flash is locked again.
+ * @param  status: FLASH_ASYNC_DONE or FLASH_ASYNC_ERROR
+ * @retval None
+ ****************************************************************************
+*/
+RAM_FUNC static void dev_flashInternalAsyncEnd(int32_t status)
+{
+    FLASH->CR &= ~(FLASH_CR_PER | FLASH_CR_PG | FLASH_CR_EOPIE | FLASH_CR_ERRIE);
+    dev_flashLock();
+    /* Nothing left for the application to inherit */
+    NVIC_DisableIRQ(FLASH_IRQn);
+    dev_flashAsyncEnd(status);
+}
+
+/**
+ ****************************************************************************
+ * @brief  Start programming the next half word that differs.
+ * @author lizdDong
+ * @note   None
+ * @param  None
+ * @retval 0: Started
+ *        -1: Nothing left
+ ****************************************************************************
+*/
+RAM_FUNC static int32_t dev_flashAsyncNext(void)
+{
+    __IO uint16_t *pFlash;
+    uint16_t data;
+
+    for(; FlashAsync.count != 0; FlashAsync.count--, FlashAsync.pFlash++, FlashAsync.pBuffer++)
+    {
+        if(*FlashAsync.pFlash != *FlashAsync.pBuffer)
+        {
+            /* Move on first, the EOP interrupt may come before the return */
+            pFlash = FlashAsync.pFlash++;
+            data = *FlashAsync.pBuffer++;
+            FlashAsync.count--;
+            *pFlash = data;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+/**
+ ****************************************************************************
+ * @brief  Start erasing a page of the internal flash.
+ * @author lizdDong
+ * @note   The flash stays unlocked until the end.
+ * @param  addr: An address in the page.
+ * @retval 0
+ ****************************************************************************
+*/
+RAM_FUNC static int32_t dev_flashInternalEraseAsync(uint32_t addr)
+{
+    FlashAsync.count = 0;
+    dev_flashUnlock();
+    NVIC_EnableIRQ(FLASH_IRQn);
+
+    FLASH->SR = FLASH_SR_EOP | FLASH_SR_PGERR | FLASH_SR_WRPRTERR;
+    FLASH->CR |= FLASH_CR_PER | FLASH_CR_EOPIE | FLASH_CR_ERRIE;
+    FLASH->AR = addr;
+    FLASH->CR |= FLASH_CR_STRT;
+    return 0;
+}
+
+/**
+ ****************************************************************************
+ * @brief  Start programming the internal flash.
+ * @author lizdDong
+ * @note   The flash stays unlocked until the end.
+ * @param  addr: The starting address to be written.(The address must be a multiple of two)
+ * @param  pBuff: The pointer to the data.(The address must be a multiple of two)
+ * @param  size: The number of byte written(8bit), The number should beat to a multiple of two.
+ * @retval 0
+ ****************************************************************************
+*/
+RAM_FUNC static int32_t dev_flashInternalProgramAsync(uint32_t addr, const uint8_t *pBuff, uint32_t size)
+{
+    FlashAsync.pFlash = (__IO uint16_t *)addr;
+    FlashAsync.pBuffer = (const uint16_t *)pBuff;
+    FlashAsync.count = size / 2;
+    dev_flashUnlock();
+    NVIC_EnableIRQ(FLASH_IRQn);
+
+    FLASH->SR = FLASH_SR_EOP | FLASH_SR_PGERR | FLASH_SR_WRPRTERR;
+    FLASH->CR |= FLASH_CR_PG | FLASH_CR_EOPIE | FLASH_CR_ERRIE;
+    if(dev_flashAsyncNext() != 0)
+    {
+        dev_flashInternalAsyncEnd(FLASH_ASYNC_DONE);
+    }
+    return 0;
+}
+
+/**
+ ****************************************************************************
+ * @brief  Start erasing a page and return at once.
+ * @author lizdDong
+ * @note   The end is signalled by the EOP or error interrupt of the
+ *         internal flash, see dev_flashAsyncStatus(). A backend without
+ *         eraseAsync erases at once. The STM32F10x flash has a single bank:
+ *         any fetch from it stalls until the erase is over, only the
+ *         RAM_FUNC code, the interrupts in SRAM and the DMA go on. Only a
+ *         caller in RAM_FUNC code gains anything over dev_flashErasePage(),
+ *         a caller in flash stalls on its next fetch for the whole erase.
+ *         Wait with dev_flashAsyncWait(), or from a loop in RAM_FUNC code.
+ * @param  addr: An address in the page.
+ * @param  callback: Called from the interrupt at the end, may be 0.
+ * @retval 0: Started
+ *        -1: An operation is running
+ ****************************************************************************
+*/
+RAM_FUNC int32_t dev_flashEraseAsync(uint32_t addr, dev_flashCallback_t callback)
+{
+    if(FlashAsync.status == FLASH_ASYNC_BUSY)
+    {
+        return -1;
+    }
+    FlashAsync.status = FLASH_ASYNC_BUSY;
+    FlashAsync.callback = callback;
+    if(FlashBackend->eraseAsync == NULL)
+    {
+        dev_flashAsyncEnd((FlashBackend->erase(addr) == 0) ? FLASH_ASYNC_DONE : FLASH_ASYNC_ERROR);
+    }
+    else if(FlashBackend->eraseAsync(addr) != 0)
+    {
+        dev_flashAsyncEnd(FLASH_ASYNC_ERROR);
+    }
+    return 0;
+}
+
+/**
+ ****************************************************************************
+ * @brief  Start programming data and return at once.
+ * @author lizdDong
+ * @note   On the internal flash each EOP interrupt starts the next half
+ *         word that differs from the data, the buffer must be kept until
+ *         the end. The code in flash stalls during each half word as for
+ *         dev_flashEraseAsync(), only a caller in RAM_FUNC code runs in
+ *         between. A backend without programAsync programs at once.
+ * @param  addr: The starting address to be written.(The address must be a multiple of two)
+ * @param  pBuff: The pointer to the data.(The address must be a multiple of two)
+ * @param  size: The number of byte written(8bit), The number should beat to a multiple of two.
+ * @param  callback: Called from the interrupt at the end, may be 0.
+ * @retval 0: Started, or nothing to program
+ *        -1: An operation is running
+ ****************************************************************************
+*/
+RAM_FUNC int32_t dev_flashProgramAsync(uint32_t addr, const uint8_t *pBuff, uint32_t size, dev_flashCallback_t callback)
+{
+    if(FlashAsync.status == FLASH_ASYNC_BUSY)
+    {
+        return -1;
+    }
+    FlashAsync.status = FLASH_ASYNC_BUSY;
+    FlashAsync.callback = callback;
+    if(FlashBackend->programAsync == NULL)
+    {
+        dev_flashAsyncEnd((FlashBackend->program(addr, pBuff, size) == 0) ? FLASH_ASYNC_DONE : FLASH_ASYNC_ERROR);
+    }
+    else if(FlashBackend->programAsync(addr, pBuff, size) != 0)
+    {
+        dev_flashAsyncEnd(FLASH_ASYNC_ERROR);
+    }
+    return 0;
+}
+
+/**
+ ****************************************************************************
+ * @brief  Get the state of the asynchronous operation.
+ * @author lizdDong
+ * @note   None
+ * @param  None
+ * @retval FLASH_ASYNC_BUSY, FLASH_ASYNC_DONE or FLASH_ASYNC_ERROR
+ ****************************************************************************
+*/
+RAM_FUNC int32_t dev_flashAsyncStatus(void)
+{
+    return FlashAsync.status;
+}
+/**
+ ****************************************************************************
+ * @brief  Wait for the end of the asynchronous operation.
+ * @author lizdDong
+ * @note   The loop runs from SRAM with FLASH_RAM_FUNC_EN, so it does not
+ *         stall on the flash and the interrupts in SRAM are served.
+ * @param  None
+ * @retval FLASH_ASYNC_DONE or FLASH_ASYNC_ERROR
+ ****************************************************************************
+*/
+RAM_FUNC int32_t dev_flashAsyncWait(void)
+{
+    while(FlashAsync.status == FLASH_ASYNC_BUSY);
+    return FlashAsync.status;
+}
+
+/**
+ ****************************************************************************
+ * @brief  FLASH end of operation and error interrupt.
+ * @author lizdDong
+ * @note   None
+ * @param  None
+ * @retval None
+ ****************************************************************************
+*/
+RAM_FUNC void FLASH_IRQHandler(void)
+{
+    uint32_t sr = FLASH->SR;
+
+    FLASH->SR = FLASH_SR_EOP | FLASH_SR_PGERR | FLASH_SR_WRPRTERR;
+    if(FlashAsync.status != FLASH_ASYNC_BUSY)
+    {
+        return;
+    }
+    if((sr & (FLASH_SR_PGERR | FLASH_SR_WRPRTERR)) != 0)
+    {
+        dev_flashInternalAsyncEnd(FLASH_ASYNC_ERROR);
+    }
+    else if((sr & FLASH_SR_EOP) != 0)
+    {
+        if(dev_flashAsyncNext() != 0)
+        {
+            dev_flashInternalAsyncEnd(FLASH_ASYNC_DONE);
+        }
+    }
+}
+
+/**
+ ****************************************************************************
+ * @brief  Compare one half word of data with the flash.
+ * @author lizdDong
+ * @note   None
+ * @param  flash: The half word in flash.
+ * @param  data: The half word to write.
+ * @retval FLASH_CMP_SAME, FLASH_CMP_WRITE or FLASH_CMP_ERASE
+ ****************************************************************************
+*/
+static uint32_t dev_flashCompareHalf(uint16_t flash, uint16_t data)
+{
+    if(flash == data)
+    {
+        return FLASH_CMP_SAME;
+    }
+    return (flash == 0xFFFF) ? FLASH_CMP_WRITE : FLASH_CMP_ERASE;
+}
+
+/**
+ ****************************************************************************
+ * @brief  Compare data with the internal flash to find what writing it takes.
+ * @author lizdDong
+ * @note   A half word can only be programmed when it reads 0xFFFF. The
+ *         range is compared a word at a time once the flash address is on
+ *         a word boundary, the half words are only looked at in the words
+ *         that differ.
+ * @param  addr: The starting address in flash.(The address must be a multiple of two)
+ * @param  pBuff: The pointer to the data.(The address must be a multiple of two)
+ * @param  size: The number of byte compared(8bit), The number should beat to a multiple of two.
+ * @retval FLASH_CMP_SAME: The flash holds the data already
+ *         FLASH_CMP_WRITE: The data can be programmed without erase
+ *         FLASH_CMP_ERASE: The page must be erased first
+ ****************************************************************************
+*/
+static uint32_t dev_flashInternalCompare(uint32_t addr, const uint8_t *pBuff, uint32_t size)
+{
+    const uint16_t *pFlash = (const uint16_t *)addr;
+    const uint16_t *pBuffer = (const uint16_t *)pBuff;
+    const uint32_t *pFlashW;
+    const uint32_t *pBufferW;
+    uint32_t i = 0, num = size / 2, cmp;
+    uint32_t result = FLASH_CMP_SAME;
+
+    /* Head half word up to a word boundary */
+    if(((addr & 0x00000002) != 0) && (num != 0))
+    {
+        result = dev_flashCompareHalf(pFlash[0], pBuffer[0]);
+        i = 1;
+    }
+
+    if((((uint32_t)&pBuffer[i]) & 0x00000003) == 0)
+    {
+        pFlashW = (const uint32_t *)&pFlash[i];
+        pBufferW = (const uint32_t *)&pBuffer[i];
+        for(; (i + 2 <= num) && (result != FLASH_CMP_ERASE); i += 2, pFlashW++, pBufferW++)
+        {
+            if(*pFlashW == *pBufferW)
+            {
+                continue;
+            }
+            if(*pFlashW == 0xFFFFFFFF)
+            {
+                result = FLASH_CMP_WRITE;
+                continue;
+            }
+            cmp = dev_flashCompareHalf((uint16_t)*pFlashW, (uint16_t)*pBufferW);
+            if(cmp > result)
+            {
+                result = cmp;
+            }
+            cmp = dev_flashCompareHalf((uint16_t)(*pFlashW >> 16), (uint16_t)(*pBufferW >> 16));
+            if(cmp > result)
+            {
+                result = cmp;
+            }
+        }
+    }
+
+    /* Tail, or a buffer not aligned like the flash */
+    for(; (i < num) && (result != FLASH_CMP_ERASE); i++)
+    {
+        cmp = dev_flashCompareHalf(pFlash[i], pBuffer[i]);
+        if(cmp > result)
+        {
+            result = cmp;
+        }
+    }
+    return result;
+}
+
+/**
+ ****************************************************************************
+ * @brief  Check if a range of the internal flash reads all 0xFF.
+ * @author lizdDong
+ * @note   Read a word at a time, four words per loop, between the
+ *         unaligned head and tail bytes.
+ * @param  addr: The starting address in flash.
+ * @param  size: The number of byte checked(8bit).
+ * @retval 1: Blank
+ *         0: Not blank
+ ****************************************************************************
+*/
+static uint32_t dev_flashInternalIsBlank(uint32_t addr, uint32_t size)
+{
+    const uint32_t *pFlashW;
+    uint32_t end = addr + size;
+
+    for(; (addr < end) && ((addr & 0x00000003) != 0); addr++)
+    {
+        if(*(const uint8_t *)addr != 0xFF)
+        {
+            return 0;
+        }
+    }
+    for(pFlashW = (const uint32_t *)addr; addr + 16 <= end; addr += 16, pFlashW += 4)
+    {
+        if((pFlashW[0] & pFlashW[1] & pFlashW[2] & pFlashW[3]) != 0xFFFFFFFF)
+        {
+            return 0;
+        }
+    }
+    for(; addr + 4 <= end; addr += 4, pFlashW++)
+    {
+        if(*pFlashW != 0xFFFFFFFF)
+        {
+            return 0;
+        }
+    }
+    for(; addr < end; addr++)
+    {
+        if(*(const uint8_t *)addr != 0xFF)
+        {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/**
+ ****************************************************************************
+ * @brief  Init of the internal flash backend.
+ * @author lizdDong
+ * @note   Clear the error flags left by a previous operation.
+ * @param  None
+ * @retval 0
+ ****************************************************************************
+*/
+static int32_t dev_flashInternalInit(void)
+{
+    FLASH->SR = FLASH_SR_EOP | FLASH_SR_PGERR | FLASH_SR_WRPRTERR;
+    return 0;
+}
+
+/**
+ ****************************************************************************
+ * @brief  Read the internal flash.
+ * @author lizdDong
+ * @note   The flash is memory mapped, the copy is word-wide when both sides
+ *         can reach a word boundary.
+ * @param  addr: The starting address.
+ * @param  pBuff: The pointer to the data.
+ * @param  size: The number of byte read(8bit)
+ * @retval 0
+ ****************************************************************************
+*/
+static int32_t dev_flashInternalRead(uint32_t addr, uint8_t *pBuff, uint32_t size)
+{
+    uint32_t i = 0;
+    uint32_t readAddr = addr;
+    uint8_t *pDst = pBuff;
+    const uint32_t *pSrcW;
+    uint32_t *pDstW;
+
+    /* A word at a time when both sides can reach a word boundary */
+    if(((readAddr ^ (uint32_t)pDst) & 0x00000003) == 0)
+    {
+        for(; (i < size) && ((readAddr & 0x00000003) != 0); i++)
+        {
+            *pDst++ = *(uint8_t *)readAddr++;
+        }
+        pSrcW = (const uint32_t *)readAddr;
+        pDstW = (uint32_t *)pDst;
+        /* Four words per loop, LDM/STM */
+        for(; i + 16 <= size; i += 16)
+        {
+            pDstW[0] = pSrcW[0];
+            pDstW[1] = pSrcW[1];
+            pDstW[2] = pSrcW[2];
+            pDstW[3] = pSrcW[3];
+            pSrcW += 4;
+            pDstW += 4;
+        }
+        for(; i + 4 <= size; i += 4)
+        {
+            *pDstW++ = *pSrcW++;
+        }
+        readAddr = (uint32_t)pSrcW;
+        pDst = (uint8_t *)pDstW;
+    }
+    for(; i < size; i++)
+    {
+        *pDst++ = *(uint8_t *)readAddr++;
+    }
+
+    return 0;
+}
+
+/* The STM32F10x flash itself */
+const dev_flashOps_t dev_flashInternal =
+{
+    FLASH_BASE,
+    FLASH_SIZE,
+    dev_flashInternalInit,
+    dev_flashInternalErase,
+    dev_flashInternalProgram,
+    dev_flashInternalCompare,
+    dev_flashInternalRead,
+    dev_flashInternalIsBlank,
+    dev_flashInternalEraseAsync,
+    dev_flashInternalProgramAsync,
+};
+
+/**
+ ****************************************************************************
+ * @brief  Compare data with the backend to find what writing it takes.
+ * @author lizdDong
+ * @note   A half word can only be programmed when it reads 0xFFFF.
+ * @param  addr: The starting address in flash.(The address must be a multiple of two)
+ * @param  pBuff: The pointer to the data.(The address must be a multiple of two)
+ * @param  size: The number of byte compared(8bit), The number should beat to a multiple of two.
+ * @retval FLASH_CMP_SAME: The flash holds the data already
+ *         FLASH_CMP_WRITE: The data can be programmed without erase
+ *         FLASH_CMP_ERASE: The page must be erased first
+ ****************************************************************************
+*/
+uint32_t dev_flashCompare(uint32_t addr, const uint8_t *pBuff, uint32_t size)
+{
+#if (FLASH_PROFILE_EN)
+    uint32_t start = DWT->CYCCNT, cmp;
+
+    cmp = FlashBackend->compare(addr, pBuff, size);
+    ProfileCompareCycles += DWT->CYCCNT - start;
+    ProfileCompareBytes += size;
+    return cmp;
+#else
+    return FlashBackend->compare(addr, pBuff, size);
+#endif
+}
+
+/**
+ ****************************************************************************
+ * @brief  Check if a range of the backend reads all 0xFF.
+ * @author lizdDong
+ * @note   None
+ * @param  addr: The starting address in flash.
+ * @param  size: The number of byte checked(8bit).
+ * @retval 1: Blank
+ *         0: Not blank
+ ****************************************************************************
+*/
+uint32_t dev_flashIsBlank(uint32_t addr, uint32_t size)
+{
+    return FlashBackend->isBlank(addr, size);
+}
+
+#if (FLASH_CACHE_PAGES)
+/**
+ ****************************************************************************
+ * @brief  Write a cache line back to the flash.
+ * @author lizdDong
+ * @note   The page is only erased when a half word can not be programmed,
+ *         and not touched at all when it holds the data already.
+ * @param  line: The cache line.
+ * @retval 0: Written back
+ *        -1: Erase or program error, the line stays dirty
+ ****************************************************************************
+*/
+static int32_t dev_flashCacheWriteBack(FlashCache_TypeDef *line)
+{
+    uint32_t cmp;
+    int32_t result = 0;
+
+    if((line->addr == 0) || (line->dirty == 0))
+    {
+        return 0;
+    }
+    cmp = FlashBackend->compare(line->addr, (const uint8_t *)line->data, PAGE_SIZE);
+    if(cmp == FLASH_CMP_ERASE)
+    {
+#if (FLASH_PROFILE_EN)
+        ProfileErases++;
+#endif
+        if(FlashBackend->erase(line->addr) != 0)
+        {
+            result = -1;
+        }
+    }
+    if((result == 0) && (cmp != FLASH_CMP_SAME) &&
+       (FlashBackend->program(line->addr, (const uint8_t *)line->data, PAGE_SIZE) != 0))
+    {
+        result = -1;
+    }
+    if(result == 0)
+    {
+        line->dirty = 0;
+    }
+    return result;
+}
+
+/**
+ ****************************************************************************
+ * @brief  Look a page up in the cache.
+ * @author lizdDong
+ * @note   None
+ * @param  page: The page address.
+ * @param  victim: Set to the line to reuse when the page is not cached,
+ *         an unused line or else the least recently used one.
+ * @retval The cache line, 0 if the page is not cached
+ ****************************************************************************
+*/
+static FlashCache_TypeDef *dev_flashCacheFind(uint32_t page, FlashCache_TypeDef **victim)
+{
+    FlashCache_TypeDef *line;
+    uint32_t i;
+
+    *victim = &FlashCache[0];
+    for(i = 0; i < FLASH_CACHE_PAGES; i++)
+    {
+        line = &FlashCache[i];
+        if(line->addr == page)
+        {
+            line->used = ++FlashCacheTick;
+            return line;
+        }
+        if((line->addr == 0) || (((*victim)->addr != 0) && (line->used < (*victim)->used)))
+        {
+            *victim = line;
+        }
+    }
+    return 0;
+}
+
+/**
+ ****************************************************************************
+ * @brief  Load a page in a cache line.
+ * @author lizdDong
+ * @note   The line must be clean.
+ * @param  line: The cache line.
+ * @param  page: The page address.
+ * @retval None
+ ****************************************************************************
+*/
+static void dev_flashCacheLoad(FlashCache_TypeDef *line, uint32_t page)
+{
+    line->addr = 0;
+    dev_flashRead(page, (uint8_t *)line->data, PAGE_SIZE);
+    line->addr = page;
+    line->dirty = 0;
+    line->used = ++FlashCacheTick;
+}
+
+/**
+ ****************************************************************************
+ * @brief  Get the cache line of a page, loaded from the flash if needed.
+ * @author lizdDong
+ * @note   The least recently used line is written back and reused.
+ * @param  page: The page address.
+ * @retval The cache line, 0 if the evicted line could not be written back
+ ****************************************************************************
+*/
+static FlashCache_TypeDef *dev_flashCacheGet(uint32_t page)
+{
+    FlashCache_TypeDef *line, *victim;
+
+    line = dev_flashCacheFind(page, &victim);
+    if(line != 0)
+    {
+        return line;
+    }
+    if(dev_flashCacheWriteBack(victim) != 0)
+    {
+        return 0;
+    }
+    dev_flashCacheLoad(victim, page);
+    return victim;
+}
 
 /**
  ****************************************************************************
- * @brief  There is no check writing.
+ * @brief  Write data from the specified address to the specified length.
  * @author lizdDong
- * @note   This function can be used for all STM32F10x devices.
- * @param  writeAddr: The starting address to be written.
- * @param  pBuffer: The pointer to the data.
- * @param  numToWrite:  The number of half words written
- * @retval None
+ * @note   The data goes to a write-back cache of FLASH_CACHE_PAGES pages,
+ *         several writes to the same page cost one erase and program at
+ *         the most. dev_flashFlush() or dev_flashSync() puts it in flash.
+ * @param  addr: The starting address to be written.(The address must be a multiple of two)
+ * @param  pBuff: The pointer to the data.
+ * @param  size: The number of byte written(8bit), The number should beat to a multiple of two.
+ * @retval The number of bytes written in the cache
  ****************************************************************************
 */
-static FLASH_Status dev_flashWriteNoCheck(uint32_t writeAddr, uint16_t *pBuffer, uint16_t numToWrite)
+uint32_t dev_flashWrite(uint32_t addr, const uint8_t *pBuff, uint32_t size)
 {
-    uint16_t i;
-    FLASH_Status status = FLASH_COMPLETE;
-    for(i = 0; i < numToWrite; i++)
+    FlashCache_TypeDef *line;
+    uint32_t offset, n;
+    uint32_t numOfWrited = 0;
+
+    if((addr < FlashBackend->base) || (addr >= FlashBackend->base + FlashBackend->size) || ((addr & 0x00000001) != 0))
+    {
+        return 0;
+    }
+    if(addr + size > FlashBackend->base + FlashBackend->size)
+    {
+        size = FlashBackend->base + FlashBackend->size - addr;
+    }
+
+    while(numOfWrited < size)
     {
-        status = FLASH_ProgramHalfWord(writeAddr, pBuffer[i]);
-        if(status != FLASH_COMPLETE)
+        offset = addr & (PAGE_SIZE - 1);
+        n = PAGE_SIZE - offset;
+        if(n > size - numOfWrited)
+        {
+            n = size - numOfWrited;
+        }
+        line = dev_flashCacheGet(addr - offset);
+        if(line == 0)
         {
             break;
         }
-        writeAddr += 2;   //add addr 2.
+        if(memcmp((uint8_t *)line->data + offset, pBuff, n) != 0)
+        {
+            memcpy((uint8_t *)line->data + offset, pBuff, n);
+            line->dirty = 1;
+        }
+        addr += n;
+        pBuff += n;
+        numOfWrited += n;
+    }
+
+    return numOfWrited;
+}
+
+/**
+ ****************************************************************************
+ * @brief  Write all the dirty pages of the cache back to the flash.
+ * @author lizdDong
+ * @note   The pages stay in the cache.
+ * @param  None
+ * @retval 0: Done
+ *        -1: A page could not be written
+ ****************************************************************************
+*/
+int32_t dev_flashFlush(void)
+{
+    uint32_t i;
+    int32_t result = 0;
+
+    for(i = 0; i < FLASH_CACHE_PAGES; i++)
+    {
+        if(dev_flashCacheWriteBack(&FlashCache[i]) != 0)
+        {
+            result = -1;
+        }
+    }
+    return result;
+}
+
+/**
+ ****************************************************************************
+ * @brief  Flush the cache and empty it.
+ * @author lizdDong
+ * @note   Needed before the flash is changed by other means (Ymodem, the
+ *         application) and before leaving the bootloader.
+ * @param  None
+ * @retval 0: Done
+ *        -1: A page could not be written, it is dropped
+ ****************************************************************************
+*/
+int32_t dev_flashSync(void)
+{
+    uint32_t i;
+    int32_t result;
+
+    result = dev_flashFlush();
+    for(i = 0; i < FLASH_CACHE_PAGES; i++)
+    {
+        FlashCache[i].addr = 0;
+        FlashCache[i].dirty = 0;
+    }
+    return result;
+}
+
+/**
+ ****************************************************************************
+ * @brief  Start writing a cache line back in steps.
+ * @author lizdDong
+ * @note   The page is erased with dev_flashEraseAsync(), a backend without
+ *         eraseAsync erases at once.
+ * @param  line: The dirty cache line.
+ * @retval FLASH_ASYNC_BUSY or FLASH_ASYNC_ERROR
+ ****************************************************************************
+*/
+static int32_t dev_flashWriteBackStart(FlashCache_TypeDef *line)
+{
+    uint32_t cmp;
+
+    cmp = FlashBackend->compare(line->addr, (const uint8_t *)line->data, PAGE_SIZE);
+    FlashWrite.offset = 0;
+    FlashWrite.erasing = 0;
+    if(cmp == FLASH_CMP_SAME)
+    {
+        line->dirty = 0;
+        return FLASH_ASYNC_BUSY;
+    }
+    FlashWrite.line = line;
+    if(cmp == FLASH_CMP_ERASE)
+    {
+#if (FLASH_PROFILE_EN)
+        ProfileErases++;
+#endif
+        if(dev_flashEraseAsync(line->addr, 0) != 0)
+        {
+            return FLASH_ASYNC_ERROR;
+        }
+        FlashWrite.erasing = 1;
+    }
+    return FLASH_ASYNC_BUSY;
+}
+
+/**
+ ****************************************************************************
+ * @brief  Go on writing back the line of FlashWrite.
+ * @author lizdDong
+ * @note   Programs FLASH_WRITE_STEP half words at the most.
+ * @param  None
+ * @retval FLASH_ASYNC_BUSY or FLASH_ASYNC_ERROR
+ ****************************************************************************
+*/
+static int32_t dev_flashWriteBackStep(void)
+{
+    FlashCache_TypeDef *line = FlashWrite.line;
+    uint32_t n;
+    int32_t status;
+
+    if(FlashWrite.erasing != 0)
+    {
+        status = dev_flashAsyncStatus();
+        if(status == FLASH_ASYNC_BUSY)
+        {
+            return FLASH_ASYNC_BUSY;
+        }
+        FlashWrite.erasing = 0;
+        return (status == FLASH_ASYNC_DONE) ? FLASH_ASYNC_BUSY : FLASH_ASYNC_ERROR;
+    }
+    n = PAGE_SIZE - FlashWrite.offset;
+    if(n > FLASH_WRITE_STEP * 2)
+    {
+        n = FLASH_WRITE_STEP * 2;
+    }
+    if(FlashBackend->program(line->addr + FlashWrite.offset, (const uint8_t *)line->data + FlashWrite.offset, n) != 0)
+    {
+        return FLASH_ASYNC_ERROR;
+    }
+    FlashWrite.offset += n;
+    if(FlashWrite.offset == PAGE_SIZE)
+    {
+        line->dirty = 0;
+        FlashWrite.line = 0;
+    }
+    return FLASH_ASYNC_BUSY;
+}
+
+/**
+ ****************************************************************************
+ * @brief  Start a write done in steps by dev_flashWriteStep().
+ * @author lizdDong
+ * @note   The data must be kept until the end. No other dev_flash write,
+ *         flush or sync meanwhile. The internal flash is unlocked once by
+ *         the first step and stays so until the end of the job.
+ * @param  addr: The starting address to be written.(The address must be a multiple of two)
+ * @param  pBuff: The pointer to the data.
+ * @param  size: The number of byte written(8bit), The number should beat to a multiple of two.
+ * @retval 0: Started
+ *        -1: Bad address or a write is running
+ ****************************************************************************
+*/
+int32_t dev_flashWriteStart(uint32_t addr, const uint8_t *pBuff, uint32_t size)
+{
+    if((FlashWrite.size != 0) || (FlashWrite.line != 0) ||
+       (addr < FlashBackend->base) || (addr >= FlashBackend->base + FlashBackend->size) || ((addr & 0x00000001) != 0))
+    {
+        return -1;
+    }
+    if(addr + size > FlashBackend->base + FlashBackend->size)
+    {
+        size = FlashBackend->base + FlashBackend->size - addr;
+    }
+    FlashWrite.pBuff = pBuff;
+    FlashWrite.addr = addr;
+    FlashWrite.size = size;
+    FlashHold = 1;
+    return 0;
+}
+
+/**
+ ****************************************************************************
+ * @brief  Do one bounded step of the write started by dev_flashWriteStart().
+ * @author lizdDong
+ * @note   A step copies one page chunk to the cache, loads one page,
+ *         programs FLASH_WRITE_STEP half words, or polls the page erase
+ *         started by an earlier step. While that erase runs the caller
+ *         stalls on its next fetch from the flash, see dev_flashEraseAsync().
+ *         The data is in the flash at FLASH_ASYNC_DONE, the dirty pages of
+ *         the cache are written back too.
+ * @param  None
+ * @retval FLASH_ASYNC_BUSY: Call again
+ *         FLASH_ASYNC_DONE: Written
+ *         FLASH_ASYNC_ERROR: Erase or program error, the write is dropped
+ ****************************************************************************
+*/
+int32_t dev_flashWriteStep(void)
+{
+    FlashCache_TypeDef *line, *victim;
+    uint32_t offset, n, i;
+    int32_t status = FLASH_ASYNC_BUSY;
+
+    if(FlashWrite.line != 0)
+    {
+        status = dev_flashWriteBackStep();
+    }
+    else if(FlashWrite.size != 0)
+    {
+        offset = FlashWrite.addr & (PAGE_SIZE - 1);
+        line = dev_flashCacheFind(FlashWrite.addr - offset, &victim);
+        if(line == 0)
+        {
+            if((victim->addr != 0) && (victim->dirty != 0))
+            {
+                status = dev_flashWriteBackStart(victim);
+            }
+            else
+            {
+                dev_flashCacheLoad(victim, FlashWrite.addr - offset);
+            }
+        }
+        else
+        {
+            n = PAGE_SIZE - offset;
+            if(n > FlashWrite.size)
+            {
+                n = FlashWrite.size;
+            }
+            if(memcmp((uint8_t *)line->data + offset, FlashWrite.pBuff, n) != 0)
+            {
+                memcpy((uint8_t *)line->data + offset, FlashWrite.pBuff, n);
+                line->dirty = 1;
+            }
+            FlashWrite.addr += n;
+            FlashWrite.pBuff += n;
+            FlashWrite.size -= n;
+        }
+    }
+    else
+    {
+        for(i = 0; i < FLASH_CACHE_PAGES; i++)
+        {
+            if((FlashCache[i].addr != 0) && (FlashCache[i].dirty != 0))
+            {
+                break;
+            }
+        }
+        if(i == FLASH_CACHE_PAGES)
+        {
+            status = FLASH_ASYNC_DONE;
+        }
+        else
+        {
+            status = dev_flashWriteBackStart(&FlashCache[i]);
+        }
+    }
+
+    if(status == FLASH_ASYNC_ERROR)
+    {
+        FlashWrite.line = 0;
+        FlashWrite.size = 0;
+    }
+    if((status != FLASH_ASYNC_BUSY) && (FlashHold != 0))
+    {
+        FlashHold = 0;
+        FLASH_Lock();
     }
     return status;
 }
 
+#else
 /**
  ****************************************************************************
  * @brief  Write data from the specified address to the specified length.
@@ -60,8 +1291,7 @@ uint32_t dev_flashWrite(uint32_t addr, const uint8_t *pBuff, uint32_t size)
     uint16_t secoff;     //ƫƵַ(16λּ)
     uint16_t secremain;  //ʣַ(16λּ)
     uint16_t i;
-    uint8_t f_need_erase = 0;
-    uint8_t f_need_write = 0;
+    uint32_t cmp;
     uint32_t offaddr;    //ȥ0X08000000ĵַ
 
     uint32_t writeAddr = addr;
@@ -69,7 +1299,7 @@ uint32_t dev_flashWrite(uint32_t addr, const uint8_t *pBuff, uint32_t size)
     uint32_t numToWrite = size / 2;             //תΪֲ
     uint32_t numOfWrited = 0;     //ʵдݳ
 
-    if((writeAddr < FLASH_BASE) || (writeAddr >= FLASH_BASE + FLASH_SIZE))
+    if((writeAddr < FlashBackend->base) || (writeAddr >= FlashBackend->base + FlashBackend->size))
     {
         //Ƿַ
         return 0;
@@ -81,13 +1311,13 @@ uint32_t dev_flashWrite(uint32_t addr, const uint8_t *pBuff, uint32_t size)
         return 0;
     }
 
-    if(writeAddr + size >= FLASH_BASE + FLASH_SIZE)
+    if(writeAddr + size >= FlashBackend->base + FlashBackend->size)
     {
         //ʵʿдĿռС
-        numToWrite = (FLASH_BASE + FLASH_SIZE - writeAddr) / 2;
+        numToWrite = (FlashBackend->base + FlashBackend->size - writeAddr) / 2;
     }
 
-    offaddr = writeAddr - FLASH_BASE;     //ʵƫƵַ.
+    offaddr = writeAddr - FlashBackend->base;     //ʵƫƵַ.
     secpos = offaddr / PAGE_SIZE;         //ַ  0~127 for STM32F103RBT6
     secoff = (offaddr % PAGE_SIZE) / 2;   //ڵƫ(2ֽΪλ.)
     secremain = PAGE_SIZE / 2 - secoff;   //ʣռС(16λּ)
@@ -98,37 +1328,17 @@ uint32_t dev_flashWrite(uint32_t addr, const uint8_t *pBuff, uint32_t size)
         secremain = numToWrite;
     }
 
-    //__set_PRIMASK(1);     /* ж */
-    FLASH_Unlock();       //
-    /* Clear pending flags (if any) */
-    FLASH_ClearFlag(FLASH_FLAG_BSY | FLASH_FLAG_EOP | FLASH_FLAG_PGERR | FLASH_FLAG_WRPRTERR);
     while(1)
     {
-        //
-        dev_flashRead(secpos * PAGE_SIZE + FLASH_BASE, (uint8_t *)FlashTemp, PAGE_SIZE);
-
-        //жǷҪִв
-        for(i = 0; i < secremain; i++)
-        {
-            //УĿַǷ뽫Ҫд
-            if(FlashTemp[secoff + i] != pBuffer[i])
-            {
-                f_need_write = 1;
-
-                //УĿַǷȫΪ0xFFFF
-                if(FlashTemp[secoff + i] != 0XFFFF)
-                {
-                    //Ҫ
-                    f_need_erase = 1;
-                    break;
-                }
-            }
-        }
-
-        if(f_need_erase)
+        cmp = FlashBackend->compare(writeAddr, (const uint8_t *)pBuffer, secremain * 2);
+        if(cmp == FLASH_CMP_ERASE)
         {
             //Ҫ
-            if(FLASH_ErasePage(secpos * PAGE_SIZE + FLASH_BASE) != FLASH_COMPLETE)   //
+#if (FLASH_PROFILE_EN)
+            ProfileErases++;
+#endif
+            dev_flashRead(secpos * PAGE_SIZE + FlashBackend->base, (uint8_t *)FlashTemp, PAGE_SIZE);
+            if(FlashBackend->erase(secpos * PAGE_SIZE + FlashBackend->base) != 0)   //
             {
                 return numToWrite;
             }
@@ -138,7 +1348,7 @@ uint32_t dev_flashWrite(uint32_t addr, const uint8_t *pBuff, uint32_t size)
                 FlashTemp[secoff + i] = pBuffer[i];
             }
             //Ȼд
-            if(dev_flashWriteNoCheck(secpos * PAGE_SIZE + FLASH_BASE, FlashTemp, PAGE_SIZE / 2) != FLASH_COMPLETE)
+            if(FlashBackend->program(secpos * PAGE_SIZE + FlashBackend->base, (const uint8_t *)FlashTemp, PAGE_SIZE) != 0)
             {
                 return numToWrite;
             }
@@ -147,9 +1357,9 @@ uint32_t dev_flashWrite(uint32_t addr, const uint8_t *pBuff, uint32_t size)
         else
         {
             //,ֱдʣ
-            if(f_need_write)
+            if(cmp == FLASH_CMP_WRITE)
             {
-                if(dev_flashWriteNoCheck(writeAddr, pBuffer, secremain) != FLASH_COMPLETE)
+                if(FlashBackend->program(writeAddr, (const uint8_t *)pBuffer, secremain * 2) != 0)
                 {
                     return numToWrite;
                 }
@@ -181,12 +1391,186 @@ uint32_t dev_flashWrite(uint32_t addr, const uint8_t *pBuff, uint32_t size)
             }
         }
     }
-    FLASH_Lock();//
-    __set_PRIMASK(0);     /* ж */
 
     return numOfWrited;
 }
 
+/**
+ ****************************************************************************
+ * @brief  Nothing to flush, dev_flashWrite() writes through.
+ * @author lizdDong
+ * @note   None
+ * @param  None
+ * @retval 0
+ ****************************************************************************
+*/
+int32_t dev_flashFlush(void)
+{
+    return 0;
+}
+
+/**
+ ****************************************************************************
+ * @brief  Nothing to flush, dev_flashWrite() writes through.
+ * @author lizdDong
+ * @note   None
+ * @param  None
+ * @retval 0
+ ****************************************************************************
+*/
+int32_t dev_flashSync(void)
+{
+    return 0;
+}
+
+/**
+ ****************************************************************************
+ * @brief  Write data at once, dev_flashWrite() writes through.
+ * @author lizdDong
+ * @note   The steps need the cache, see FLASH_CACHE_PAGES.
+ * @param  addr: The starting address to be written.(The address must be a multiple of two)
+ * @param  pBuff: The pointer to the data.
+ * @param  size: The number of byte written(8bit), The number should beat to a multiple of two.
+ * @retval 0: Written
+ *        -1: Write error
+ ****************************************************************************
+*/
+int32_t dev_flashWriteStart(uint32_t addr, const uint8_t *pBuff, uint32_t size)
+{
+    FlashWriteStatus = (dev_flashWrite(addr, pBuff, size) == size) ? FLASH_ASYNC_DONE : FLASH_ASYNC_ERROR;
+    return (FlashWriteStatus == FLASH_ASYNC_DONE) ? 0 : -1;
+}
+
+/**
+ ****************************************************************************
+ * @brief  Get the result of dev_flashWriteStart().
+ * @author lizdDong
+ * @note   None
+ * @param  None
+ * @retval FLASH_ASYNC_DONE or FLASH_ASYNC_ERROR
+ ****************************************************************************
+*/
+int32_t dev_flashWriteStep(void)
+{
+    return FlashWriteStatus;
+}
+#endif
+
+/**
+ ****************************************************************************
+ * @brief  Check that a range lies in one partition of dev_flash_cfg.h.
+ * @author lizdDong
+ * @note   The bootloader itself is not a partition.
+ * @param  addr: The starting address.
+ * @param  size: The number of byte(8bit).
+ * @retval 0: In a partition
+ *        -1: Out of the partitions or across two of them
+ ****************************************************************************
+*/
+static int32_t dev_flashPartitionCheck(uint32_t addr, uint32_t size)
+{
+    static const uint32_t partition[][2] =
+    {
+        {IAP_APP_ADDR,   IAP_APP_SIZE},
+        {IAP_IMAGE_ADDR, IAP_IMAGE_SIZE},
+        {IAP_FLAG_ADDR,  PAGE_SIZE * 2},
+    };
+    uint32_t i;
+
+    for(i = 0; i < sizeof(partition) / sizeof(partition[0]); i++)
+    {
+        if((addr >= partition[i][0]) && (size <= partition[i][1]) &&
+           (addr - partition[i][0] <= partition[i][1] - size))
+        {
+            return 0;
+        }
+    }
+    return -1;
+}
+
+/**
+ ****************************************************************************
+ * @brief  Erase a range of pages.
+ * @author lizdDong
+ * @note   The pages already blank are skipped. The cached pages of the
+ *         range are dropped, their pending writes are lost. No mass erase
+ *         is used: the parts of dev_flash.h have a single bank, a mass
+ *         erase would take the bootloader with it.
+ * @param  addr: The starting address.(The address must be a page boundary)
+ * @param  size: The number of byte erased(8bit), a multiple of PAGE_SIZE.
+ * @param  progress: Called after each page with the pages done and the
+ *         total, may be NULL.
+ * @retval 0: Erased
+ *        -1: Bad range or erase error
+ ****************************************************************************
+*/
+int32_t dev_flashEraseRange(uint32_t addr, uint32_t size, dev_flashProgress_t progress)
+{
+    uint32_t done, total = size / PAGE_SIZE;
+    int32_t result = 0;
+#if (FLASH_CACHE_PAGES)
+    uint32_t i;
+#endif
+
+    if(((addr & (PAGE_SIZE - 1)) != 0) || ((size & (PAGE_SIZE - 1)) != 0) ||
+       (size == 0) || (dev_flashPartitionCheck(addr, size) != 0))
+    {
+        return -1;
+    }
+
+#if (FLASH_CACHE_PAGES)
+    for(i = 0; i < FLASH_CACHE_PAGES; i++)
+    {
+        if((FlashCache[i].addr >= addr) && (FlashCache[i].addr < addr + size))
+        {
+            FlashCache[i].addr = 0;
+            FlashCache[i].dirty = 0;
+        }
+    }
+#endif
+
+    for(done = 0; done < total; done++, addr += PAGE_SIZE)
+    {
+        if(dev_flashIsBlank(addr, PAGE_SIZE) == 0)
+        {
+            if(dev_flashErasePage(addr) != 0)
+            {
+                result = -1;
+                break;
+            }
+#if (FLASH_PROFILE_EN)
+            ProfileErases++;
+#endif
+        }
+        if(progress != NULL)
+        {
+            progress(done + 1, total);
+        }
+    }
+
+    return result;
+}
+
+/**
+ ****************************************************************************
+ * @brief  Select the device behind the dev_flash functions.
+ * @author lizdDong
+ * @note   The cache is synced to the previous device first.
+ * @param  ops: The backend, dev_flashInternal by default.
+ * @retval 0: Selected
+ *        -1: The cache could not be synced or the init failed
+ ****************************************************************************
+*/
+int32_t dev_flashSetBackend(const dev_flashOps_t *ops)
+{
+    if(dev_flashSync() != 0)
+    {
+        return -1;
+    }
+    FlashBackend = ops;
+    return (ops->init != NULL) ? ops->init() : 0;
+}
+
 /**
  ****************************************************************************
  * @brief  Start reading the specified data from the specified address.
@@ -200,20 +1584,49 @@ uint32_t dev_flashWrite(uint32_t addr, const uint8_t *pBuff, uint32_t size)
 */
 uint32_t dev_flashRead(uint32_t addr, uint8_t *pBuff, uint32_t size)
 {
+#if (FLASH_CACHE_PAGES)
     uint32_t i;
-    uint32_t readAddr = addr;
+#endif
+#if (FLASH_PROFILE_EN)
+    uint32_t cycles = DWT->CYCCNT;
+#endif
 
-    if(readAddr + size >= FLASH_BASE + FLASH_SIZE)
+    if((addr < FlashBackend->base) || (addr >= FlashBackend->base + FlashBackend->size))
+    {
+        return 0;
+    }
+    if(addr + size > FlashBackend->base + FlashBackend->size)
     {
-        //ʵʿɶȡݳ
-        size = FLASH_BASE + FLASH_SIZE - readAddr;
+        size = FlashBackend->base + FlashBackend->size - addr;
+    }
+    if(FlashBackend->read(addr, pBuff, size) != 0)
+    {
+        return 0;
     }
 
-    for(i = 0; i < size; i++)
+#if (FLASH_CACHE_PAGES)
+    /* The cached pages are newer than the flash */
+    for(i = 0; i < FLASH_CACHE_PAGES; i++)
     {
-        *pBuff++ = *(uint8_t *)readAddr++;
+        uint32_t start, end;
+
+        if(FlashCache[i].addr == 0)
+        {
+            continue;
+        }
+        start = (FlashCache[i].addr > addr) ? FlashCache[i].addr : addr;
+        end = (FlashCache[i].addr + PAGE_SIZE < addr + size) ? FlashCache[i].addr + PAGE_SIZE : addr + size;
+        if(start < end)
+        {
+            memcpy(pBuff + (start - addr), (uint8_t *)FlashCache[i].data + (start - FlashCache[i].addr), end - start);
+        }
     }
+#endif
 
+#if (FLASH_PROFILE_EN)
+    ProfileReadCycles += DWT->CYCCNT - cycles;
+    ProfileReadBytes += size;
+#endif
     return size;
 }
 
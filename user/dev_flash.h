@@ -47,8 +47,67 @@
 #define LAST3_PAGE    ((uint32_t)(FLASH_BASE + FLASH_SIZE - PAGE_SIZE * 4))
 
 
+/* dev_flashCompare() results */
+#define FLASH_CMP_SAME    (0)
+#define FLASH_CMP_WRITE   (1)
+#define FLASH_CMP_ERASE   (2)
+
+
+/* dev_flashAsyncStatus() and dev_flashWriteStep() results */
+#define FLASH_ASYNC_DONE  (0)
+#define FLASH_ASYNC_BUSY  (1)
+#define FLASH_ASYNC_ERROR (-1)
+
+/* Called from the FLASH interrupt at the end of an asynchronous operation */
+typedef void (*dev_flashCallback_t)(int32_t status);
+
+/* Called by dev_flashEraseRange() after each page */
+typedef void (*dev_flashProgress_t)(uint32_t done, uint32_t total);
+
+/* A flash device behind all the dev_flash functions, erased in pages of
+   PAGE_SIZE */
+typedef struct
+{
+    uint32_t base;                  /* address of the first byte */
+    uint32_t size;                  /* bytes */
+    int32_t (*init)(void);
+    int32_t (*erase)(uint32_t addr);
+    int32_t (*program)(uint32_t addr, const uint8_t *pBuff, uint32_t size);
+    uint32_t (*compare)(uint32_t addr, const uint8_t *pBuff, uint32_t size);
+    int32_t (*read)(uint32_t addr, uint8_t *pBuff, uint32_t size);
+    uint32_t (*isBlank)(uint32_t addr, uint32_t size);
+    /* Start an operation ended by an interrupt, see dev_flashEraseAsync(),
+       NULL: done at once by erase or program */
+    int32_t (*eraseAsync)(uint32_t addr);
+    int32_t (*programAsync)(uint32_t addr, const uint8_t *pBuff, uint32_t size);
+} dev_flashOps_t;
+
+extern const dev_flashOps_t dev_flashInternal;
+
+
+int32_t dev_flashErasePage(uint32_t addr);
+int32_t dev_flashProgram(uint32_t addr, const uint8_t *pBuff, uint32_t size);
+int32_t dev_flashEraseAsync(uint32_t addr, dev_flashCallback_t callback);
+int32_t dev_flashProgramAsync(uint32_t addr, const uint8_t *pBuff, uint32_t size, dev_flashCallback_t callback);
+int32_t dev_flashAsyncStatus(void);
+int32_t dev_flashAsyncWait(void);
+int32_t dev_flashEraseRange(uint32_t addr, uint32_t size, dev_flashProgress_t progress);
+uint32_t dev_flashCompare(uint32_t addr, const uint8_t *pBuff, uint32_t size);
+uint32_t dev_flashIsBlank(uint32_t addr, uint32_t size);
 uint32_t dev_flashWrite(uint32_t addr, const uint8_t *pBuff, uint32_t size);
+int32_t dev_flashWriteStart(uint32_t addr, const uint8_t *pBuff, uint32_t size);
+int32_t dev_flashWriteStep(void);
 uint32_t dev_flashRead(uint32_t addr, uint8_t *pBuff, uint32_t size);
+int32_t dev_flashFlush(void);
+int32_t dev_flashSync(void);
+int32_t dev_flashSetBackend(const dev_flashOps_t *ops);
+#if (FLASH_PROFILE_EN)
+void dev_flashProfileReset(void);
+uint32_t dev_flashCyclesPerKB(void);
+uint32_t dev_flashEraseCount(void);
+uint32_t dev_flashReadCyclesPerKB(void);
+uint32_t dev_flashCompareCyclesPerKB(void);
+#endif
 
 
 #endif
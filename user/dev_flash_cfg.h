@@ -27,6 +27,39 @@
 #endif
 
 
+/* Program through the FLASH registers, PG set once per range.
+   0: one StdPeriph FLASH_ProgramHalfWord() per half word */
+#define FLASH_FAST_PROGRAM       1
+
+/* Count the CPU cycles spent programming, reading and comparing, see
+   dev_flashCyclesPerKB(), dev_flashReadCyclesPerKB() */
+#define FLASH_PROFILE_EN         1
+
+/* Pages kept by the write-back cache of dev_flashWrite(), PAGE_SIZE of
+   SRAM each. 0: write through */
+#ifndef FLASH_CACHE_PAGES
+#define FLASH_CACHE_PAGES        2
+#endif
+
+/* Half words programmed per dev_flashWriteStep(), about 50us each on the
+   STM32F10x: a row of 32 is about 1.7ms, the 256 bytes the UART DMA ring
+   takes in at 115200 meanwhile are far below UART_RX_BUF_SIZE */
+#ifndef FLASH_WRITE_STEP
+#define FLASH_WRITE_STEP         32
+#endif
+
+/* Run the erase/program primitives, the FLASH and SysTick interrupts and
+   the vector table from SRAM, so the interrupts are served while the flash
+   is busy. RAM_FUNC code goes to the RAMCODE section of stmboot.sct */
+#define FLASH_RAM_FUNC_EN        1
+
+#if (FLASH_RAM_FUNC_EN)
+#define RAM_FUNC                 __attribute__((section("RAMCODE")))
+#else
+#define RAM_FUNC
+#endif
+
+
 #define IAP_BOOT_SIZE            (1024 * 16)
 
 #define IAP_APP_ADDR             (FLASH_BASE + IAP_BOOT_SIZE)
@@ -35,7 +68,11 @@
 #define IAP_IMAGE_ADDR           (IAP_APP_ADDR + IAP_APP_SIZE)
 #define IAP_IMAGE_SIZE           IAP_APP_SIZE
 
+/* One page, the boot state journal of iap_state.c, and its spare page
+   used to compact the journal when it is full */
 #define IAP_FLAG_ADDR            (IAP_IMAGE_ADDR + IAP_IMAGE_SIZE)
+#define IAP_STATE_SPARE_ADDR     (IAP_FLAG_ADDR + PAGE_SIZE)
+/* Boot state asking for the copy of the image to the application */
 #define IAP_FLAG                 0xA55A
 
 #endif
@@ -0,0 +1,256 @@
+/**
+ ******************************************************************************
+ * @file    dev_flash_sim.c
+ * @author  lizdDong
+ * @version V1.0
+ * @date    2026-10-17
+ * @brief   Flash backend simulated in SRAM. It follows the STM32F10x rules:
+ *          a page erases to 0xFF, a half word can only be programmed when it
+ *          reads 0xFFFF or to 0x0000, else it is refused with PGERR. The
+ *          erases and the half words are counted, per page for the erases,
+ *          with the time the real flash would spend on them.
+ * @attention
+ *
+ ******************************************************************************
+ */
+
+#include <string.h>
+#include "stm32f10x.h"
+#include "dev_flash_sim.h"
+
+
+#define FLASH_SIM_SIZE           (FLASH_SIM_PAGES * PAGE_SIZE)
+
+static uint16_t FlashSimMem[FLASH_SIM_SIZE / 2];
+dev_flashSimStat_t dev_flashSimStat;
+
+/**
+ ****************************************************************************
+ * @brief  Check that a range lies in the simulated flash.
+ * @author lizdDong
+ * @note   None
+ * @param  addr: The starting address.
+ * @param  size: The number of byte(8bit).
+ * @retval 0: In range
+ *        -1: Out of range
+ ****************************************************************************
+*/
+static int32_t dev_flashSimCheck(uint32_t addr, uint32_t size)
+{
+    if((addr < FLASH_SIM_BASE) || (size > FLASH_SIM_SIZE) ||
+       (addr - FLASH_SIM_BASE > FLASH_SIM_SIZE - size))
+    {
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ ****************************************************************************
+ * @brief  Set all the simulated flash to a value and clear the counters.
+ * @author lizdDong
+ * @note   0xFF gives a blank flash.
+ * @param  value: The byte value.
+ * @retval None
+ ****************************************************************************
+*/
+void dev_flashSimFill(uint8_t value)
+{
+    memset(FlashSimMem, value, sizeof(FlashSimMem));
+    memset(&dev_flashSimStat, 0, sizeof(dev_flashSimStat));
+}
+
+/**
+ ****************************************************************************
+ * @brief  Init of the simulated flash.
+ * @author lizdDong
+ * @note   The content is kept.
+ * @param  None
+ * @retval 0
+ ****************************************************************************
+*/
+static int32_t dev_flashSimInit(void)
+{
+    return 0;
+}
+
+/**
+ ****************************************************************************
+ * @brief  Erase a page of the simulated flash.
+ * @author lizdDong
+ * @note   None
+ * @param  addr: An address in the page.
+ * @retval 0: Erased
+ *        -1: Out of range
+ ****************************************************************************
+*/
+static int32_t dev_flashSimErase(uint32_t addr)
+{
+    uint32_t page;
+
+    if(dev_flashSimCheck(addr, 1) != 0)
+    {
+        return -1;
+    }
+    page = (addr - FLASH_SIM_BASE) / PAGE_SIZE;
+    memset(&FlashSimMem[page * PAGE_SIZE / 2], 0xFF, PAGE_SIZE);
+    dev_flashSimStat.erases++;
+    dev_flashSimStat.wear[page]++;
+    dev_flashSimStat.busy_us += FLASH_SIM_ERASE_US;
+    return 0;
+}
+
+/**
+ ****************************************************************************
+ * @brief  Program the simulated flash.
+ * @author lizdDong
+ * @note   The half words that already hold the data are not programmed,
+ *         as by the internal flash. The range goes on after a refused
+ *         half word, the error is reported at the end.
+ * @param  addr: The starting address to be written.(The address must be a multiple of two)
+ * @param  pBuff: The pointer to the data.(The address must be a multiple of two)
+ * @param  size: The number of byte written(8bit), The number should beat to a multiple of two.
+ * @retval 0: Programmed
+ *        -1: Out of range or PGERR
+ ****************************************************************************
+*/
+static int32_t dev_flashSimProgram(uint32_t addr, const uint8_t *pBuff, uint32_t size)
+{
+    const uint16_t *pBuffer = (const uint16_t *)pBuff;
+    uint16_t *pFlash;
+    uint32_t i, err = 0;
+
+    if(((addr & 0x00000001) != 0) || (dev_flashSimCheck(addr, size) != 0))
+    {
+        return -1;
+    }
+    pFlash = &FlashSimMem[(addr - FLASH_SIM_BASE) / 2];
+    for(i = 0; i < size / 2; i++)
+    {
+        if(pFlash[i] == pBuffer[i])
+        {
+            continue;
+        }
+        if((pFlash[i] == 0xFFFF) || (pBuffer[i] == 0x0000))
+        {
+            pFlash[i] = pBuffer[i];
+            dev_flashSimStat.programs++;
+            dev_flashSimStat.busy_us += FLASH_SIM_PROGRAM_US;
+        }
+        else
+        {
+            dev_flashSimStat.errors++;
+            err = 1;
+        }
+    }
+    return (err == 0) ? 0 : -1;
+}
+
+/**
+ ****************************************************************************
+ * @brief  Compare data with the simulated flash.
+ * @author lizdDong
+ * @note   A half word can only be programmed when it reads 0xFFFF.
+ * @param  addr: The starting address in flash.(The address must be a multiple of two)
+ * @param  pBuff: The pointer to the data.(The address must be a multiple of two)
+ * @param  size: The number of byte compared(8bit), The number should beat to a multiple of two.
+ * @retval FLASH_CMP_SAME, FLASH_CMP_WRITE or FLASH_CMP_ERASE, FLASH_CMP_ERASE
+ *         out of range
+ ****************************************************************************
+*/
+static uint32_t dev_flashSimCompare(uint32_t addr, const uint8_t *pBuff, uint32_t size)
+{
+    const uint16_t *pBuffer = (const uint16_t *)pBuff;
+    const uint16_t *pFlash;
+    uint32_t i, result = FLASH_CMP_SAME;
+
+    if(dev_flashSimCheck(addr, size) != 0)
+    {
+        return FLASH_CMP_ERASE;
+    }
+    pFlash = &FlashSimMem[(addr - FLASH_SIM_BASE) / 2];
+    for(i = 0; i < size / 2; i++)
+    {
+        if(pFlash[i] == pBuffer[i])
+        {
+            continue;
+        }
+        if(pFlash[i] != 0xFFFF)
+        {
+            return FLASH_CMP_ERASE;
+        }
+        result = FLASH_CMP_WRITE;
+    }
+    return result;
+}
+
+/**
+ ****************************************************************************
+ * @brief  Read the simulated flash.
+ * @author lizdDong
+ * @note   None
+ * @param  addr: The starting address.
+ * @param  pBuff: The pointer to the data.
+ * @param  size: The number of byte read(8bit)
+ * @retval 0: Read
+ *        -1: Out of range
+ ****************************************************************************
+*/
+static int32_t dev_flashSimRead(uint32_t addr, uint8_t *pBuff, uint32_t size)
+{
+    if(dev_flashSimCheck(addr, size) != 0)
+    {
+        return -1;
+    }
+    memcpy(pBuff, (const uint8_t *)FlashSimMem + (addr - FLASH_SIM_BASE), size);
+    return 0;
+}
+
+/**
+ ****************************************************************************
+ * @brief  Check if a range of the simulated flash reads all 0xFF.
+ * @author lizdDong
+ * @note   None
+ * @param  addr: The starting address in flash.
+ * @param  size: The number of byte checked(8bit).
+ * @retval 1: Blank
+ *         0: Not blank or out of range
+ ****************************************************************************
+*/
+static uint32_t dev_flashSimIsBlank(uint32_t addr, uint32_t size)
+{
+    const uint8_t *pFlash;
+    uint32_t i;
+
+    if(dev_flashSimCheck(addr, size) != 0)
+    {
+        return 0;
+    }
+    pFlash = (const uint8_t *)FlashSimMem + (addr - FLASH_SIM_BASE);
+    for(i = 0; i < size; i++)
+    {
+        if(pFlash[i] != 0xFF)
+        {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/* The simulated flash, the asynchronous operations are done at once */
+const dev_flashOps_t dev_flashSim =
+{
+    FLASH_SIM_BASE,
+    FLASH_SIM_SIZE,
+    dev_flashSimInit,
+    dev_flashSimErase,
+    dev_flashSimProgram,
+    dev_flashSimCompare,
+    dev_flashSimRead,
+    dev_flashSimIsBlank,
+    NULL,
+    NULL,
+};
+
+
+/****************************** End of file ***********************************/
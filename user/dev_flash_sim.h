@@ -0,0 +1,51 @@
+/**
+  ******************************************************************************
+  * @file    dev_flash_sim.h
+  * @author  lizdDong
+  * @version V1.0
+  * @date    2026-10-17
+  * @brief   Flash backend simulated in SRAM, for the host tests and to try
+  *          the dev_flash users without wearing the flash.
+  * @attention
+  *
+  ******************************************************************************
+  */
+
+#ifndef _DEV_FLASH_SIM_H_
+#define _DEV_FLASH_SIM_H_
+
+#include <stdint.h>
+#include "dev_flash.h"
+
+
+/* Addresses covered by dev_flashSim, PAGE_SIZE of SRAM per page */
+#ifndef FLASH_SIM_BASE
+#define FLASH_SIM_BASE           IAP_IMAGE_ADDR
+#endif
+#ifndef FLASH_SIM_PAGES
+#define FLASH_SIM_PAGES          4
+#endif
+
+/* Typical times of the STM32F10x datasheet */
+#define FLASH_SIM_ERASE_US       20000
+#define FLASH_SIM_PROGRAM_US     52
+
+typedef struct
+{
+    uint32_t erases;                    /* pages erased */
+    uint32_t programs;                  /* half words programmed */
+    uint32_t errors;                    /* half words refused, PGERR */
+    uint32_t busy_us;                   /* time the flash would be busy */
+    uint32_t wear[FLASH_SIM_PAGES];     /* erases per page */
+} dev_flashSimStat_t;
+
+extern const dev_flashOps_t dev_flashSim;
+extern dev_flashSimStat_t dev_flashSimStat;
+
+
+void dev_flashSimFill(uint8_t value);
+
+
+#endif
+
+/****************************** End of file ***********************************/
@@ -0,0 +1,65 @@
+/**
+ ******************************************************************************
+ * @file    dev_timer.c
+ * @author  lizdDong
+ * @version V1.0
+ * @date    2026-10-17
+ * @brief   Millisecond deadlines on gMsCounter, which is counted by the
+ *          SysTick_Handler() every 1ms. The timeouts no longer depend on
+ *          SYSCLK_FREQ_xxx or on the optimisation level.
+ * @attention
+ *
+ ******************************************************************************
+ */
+
+#include "stm32f10x.h"
+#include "dev_timer.h"
+
+
+extern __IO uint32_t gMsCounter;
+
+/**
+ ****************************************************************************
+ * @brief  Get the milliseconds since power on.
+ * @author lizdDong
+ * @note   The counter wraps after 49 days.
+ * @param  None
+ * @retval The milliseconds
+ ****************************************************************************
+*/
+uint32_t dev_timerGetMs(void)
+{
+    return gMsCounter;
+}
+
+/**
+ ****************************************************************************
+ * @brief  Get the deadline after the specified time.
+ * @author lizdDong
+ * @note   None
+ * @param  ms: The time from now in milliseconds.
+ * @retval The deadline for dev_timerExpired()
+ ****************************************************************************
+*/
+uint32_t dev_timerDeadline(uint32_t ms)
+{
+    return gMsCounter + ms;
+}
+
+/**
+ ****************************************************************************
+ * @brief  Check whether the deadline is reached.
+ * @author lizdDong
+ * @note   Safe across the wrap of the counter.
+ * @param  deadline: The value from dev_timerDeadline().
+ * @retval 1: Expired
+ *         0: Not yet
+ ****************************************************************************
+*/
+uint32_t dev_timerExpired(uint32_t deadline)
+{
+    return ((int32_t)(gMsCounter - deadline) >= 0) ? 1 : 0;
+}
+
+
+/****************************** End of file ***********************************/
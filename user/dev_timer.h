@@ -0,0 +1,25 @@
+/**
+  ******************************************************************************
+  * @file    dev_timer.h
+  * @author  lizdDong
+  * @version V1.0
+  * @date    2026-10-17
+  * @brief   Millisecond deadlines on the SysTick counter.
+  * @attention
+  *
+  ******************************************************************************
+  */
+
+#ifndef _DEV_TIMER_H_
+#define _DEV_TIMER_H_
+
+#include <stdint.h>
+
+
+uint32_t dev_timerGetMs(void);
+uint32_t dev_timerDeadline(uint32_t ms);
+uint32_t dev_timerExpired(uint32_t deadline);
+
+
+#endif
+
@@ -0,0 +1,139 @@
+/**
+ ******************************************************************************
+ * @file    dev_uart.c
+ * @author  lizdDong
+ * @version V1.0
+ * @date    2026-10-17
+ * @brief   The receiver of COM_PORT is fed by DMA into a circular buffer, so
+ *          bytes keep arriving while the CPU is stalled by flash erase/program.
+ * @attention
+ *
+ ******************************************************************************
+ */
+
+#include "stm32f10x.h"
+#include "iap_cfg.h"
+#include "dev_uart.h"
+
+
+#if (USART_PORT_USE == 1)
+#define UART_RX_DMA_CH       DMA1_Channel5
+#elif (USART_PORT_USE == 3)
+#define UART_RX_DMA_CH       DMA1_Channel3
+#endif
+
+#if ((UART_RX_BUF_SIZE & (UART_RX_BUF_SIZE - 1)) != 0)
+#error "UART_RX_BUF_SIZE must be a power of two."
+#endif
+
+/* Write index of the DMA, the NDTR counts down from UART_RX_BUF_SIZE to 1 */
+#define UART_RX_HEAD()       ((UART_RX_BUF_SIZE - DMA_GetCurrDataCounter(UART_RX_DMA_CH)) & (UART_RX_BUF_SIZE - 1))
+
+static uint8_t RxBuff[UART_RX_BUF_SIZE];
+static uint32_t RxTail = 0;
+
+/**
+ ****************************************************************************
+ * @brief  Start the circular DMA reception of COM_PORT.
+ * @author lizdDong
+ * @note   Must be called after USART_Init().
+ * @param  None
+ * @retval None
+ ****************************************************************************
+*/
+void dev_uartInit(void)
+{
+    DMA_InitTypeDef DMA_InitStructure;
+
+    RCC_AHBPeriphClockCmd(RCC_AHBPeriph_DMA1, ENABLE);
+
+    DMA_DeInit(UART_RX_DMA_CH);
+    DMA_InitStructure.DMA_PeripheralBaseAddr = (uint32_t)&COM_PORT->DR;
+    DMA_InitStructure.DMA_MemoryBaseAddr = (uint32_t)RxBuff;
+    DMA_InitStructure.DMA_DIR = DMA_DIR_PeripheralSRC;
+    DMA_InitStructure.DMA_BufferSize = UART_RX_BUF_SIZE;
+    DMA_InitStructure.DMA_PeripheralInc = DMA_PeripheralInc_Disable;
+    DMA_InitStructure.DMA_MemoryInc = DMA_MemoryInc_Enable;
+    DMA_InitStructure.DMA_PeripheralDataSize = DMA_PeripheralDataSize_Byte;
+    DMA_InitStructure.DMA_MemoryDataSize = DMA_MemoryDataSize_Byte;
+    DMA_InitStructure.DMA_Mode = DMA_Mode_Circular;
+    DMA_InitStructure.DMA_Priority = DMA_Priority_VeryHigh;
+    DMA_InitStructure.DMA_M2M = DMA_M2M_Disable;
+    DMA_Init(UART_RX_DMA_CH, &DMA_InitStructure);
+
+    RxTail = 0;
+    DMA_Cmd(UART_RX_DMA_CH, ENABLE);
+    USART_DMACmd(COM_PORT, USART_DMAReq_Rx, ENABLE);
+}
+
+/**
+ ****************************************************************************
+ * @brief  Stop the DMA reception and put the DMA back in reset state
+ *         before jumping to the application.
+ * @author lizdDong
+ * @note   None
+ * @param  None
+ * @retval None
+ ****************************************************************************
+*/
+void dev_uartDeinit(void)
+{
+    USART_DMACmd(COM_PORT, USART_DMAReq_Rx, DISABLE);
+    DMA_Cmd(UART_RX_DMA_CH, DISABLE);
+    DMA_DeInit(UART_RX_DMA_CH);
+    RCC_AHBPeriphClockCmd(RCC_AHBPeriph_DMA1, DISABLE);
+}
+
+/**
+ ****************************************************************************
+ * @brief  Get the number of bytes waiting in the receive buffer.
+ * @author lizdDong
+ * @note   More than UART_RX_BUF_SIZE bytes unread can not be detected, the
+ *         buffer must be sized for the longest time the reader is blocked.
+ * @param  None
+ * @retval The number of bytes
+ ****************************************************************************
+*/
+uint32_t dev_uartAvailable(void)
+{
+    return (UART_RX_HEAD() - RxTail) & (UART_RX_BUF_SIZE - 1);
+}
+
+/**
+ ****************************************************************************
+ * @brief  Get one byte from the receive buffer, never blocks.
+ * @author lizdDong
+ * @note   None
+ * @param  c: The pointer to save the byte.
+ * @retval 0: Byte received
+ *        -1: The buffer is empty
+ ****************************************************************************
+*/
+int32_t dev_uartGetc(uint8_t *c)
+{
+    if(RxTail == UART_RX_HEAD())
+    {
+        return -1;
+    }
+    *c = RxBuff[RxTail];
+    RxTail = (RxTail + 1) & (UART_RX_BUF_SIZE - 1);
+    return 0;
+}
+
+/**
+ ****************************************************************************
+ * @brief  Drop all the bytes waiting in the receive buffer.
+ * @author lizdDong
+ * @note   None
+ * @param  None
+ * @retval None
+ ****************************************************************************
+*/
+void dev_uartFlush(void)
+{
+    RxTail = UART_RX_HEAD();
+}
+
+
+/****************************** End of file ***********************************/
+
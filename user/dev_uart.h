@@ -0,0 +1,27 @@
+/**
+  ******************************************************************************
+  * @file    dev_uart.h
+  * @author  lizdDong
+  * @version V1.0
+  * @date    2026-10-17
+  * @brief   DMA circular receive buffer of COM_PORT.
+  * @attention
+  *
+  ******************************************************************************
+  */
+
+#ifndef _DEV_UART_H_
+#define _DEV_UART_H_
+
+#include <stdint.h>
+
+
+void dev_uartInit(void);
+void dev_uartDeinit(void);
+uint32_t dev_uartAvailable(void);
+int32_t dev_uartGetc(uint8_t *c);
+void dev_uartFlush(void);
+
+
+#endif
+
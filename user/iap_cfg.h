@@ -28,8 +28,59 @@
 
 #define UPGRADE_FROM_IMAGE   1
 
+/* Boot in place the newest valid image of IAP_APP_ADDR and IAP_IMAGE_ADDR,
+   nothing is copied. Each slot holds an iap_imageHeader_t and a payload
+   linked at slot + IAP_IMAGE_HDR_SIZE. Ymodem receives into the other
+   slot, see iap_imageTarget(). */
+#define IAP_DUAL_SLOT        0
+
+/* heatshrink parameters of the compressed images (-w, -l), the decoder
+   takes 2^IAP_LZ_WINDOW bytes of SRAM. The host tests build several
+   windows by defining them on the command line. */
+#ifndef IAP_LZ_WINDOW
+#define IAP_LZ_WINDOW        10
+#endif
+#ifndef IAP_LZ_LOOKAHEAD
+#define IAP_LZ_LOOKAHEAD     4
+#endif
+
+#if (IAP_DUAL_SLOT) && (UPGRADE_FROM_IMAGE)
+#error "IAP_DUAL_SLOT boots the image slot in place, UPGRADE_FROM_IMAGE must be 0."
+#endif
+
 #define COM_PORT         USART3
 #define USART_PORT_USE   3
+#define COM_BAUDRATE     115200
+
+/* DMA receive buffer of COM_PORT, power of two, must hold all the bytes
+   arriving while the CPU is blocked by a page erase */
+#define UART_RX_BUF_SIZE (1024 * 4)
+
+/* CRC16 kernel of the Ymodem packets, CRC16_METHOD_xxx in crc16.h. The host
+   tests build each kernel by defining it on the command line. */
+#ifndef CRC16_METHOD
+#define CRC16_METHOD     CRC16_METHOD_TABLE
+#endif
+
+/* Ask the sender for Ymodem-G streaming, a CRC error cancels the stream.
+   With YMODEM_G_RESUME the receiver then waits for the same file in
+   classic Ymodem, the pages already in flash compare equal and are skipped. */
+#define YMODEM_G_EN      1
+#define YMODEM_G_RESUME  1
+
+/* Sliding window extension of Ymodem: a sender offering it in the filename
+   packet may keep up to YMODEM_W_SIZE (1..8) packets unacknowledged, lost
+   packets are asked again by NAK with the bitmap of the ones kept after it.
+   Each window slot takes one packet buffer of SRAM. */
+#define YMODEM_W_EN      1
+#define YMODEM_W_SIZE    4
+
+/* A file named *YMODEM_LZ_SUFFIX is heatshrink compressed (see iap_lz.c)
+   and decompressed as it is received, the decoder takes
+   2^IAP_LZ_WINDOW + YMODEM_LZ_BUF_SIZE bytes of SRAM */
+#define YMODEM_LZ_EN     1
+#define YMODEM_LZ_SUFFIX ".hs"
+#define YMODEM_LZ_BUF_SIZE 256
 
 #if (USE_RS485_PORT)
 #define RCC_RS485_TXEN   RCC_APB2Periph_GPIOA
@@ -0,0 +1,148 @@
+/**
+ ******************************************************************************
+ * @file    iap_image.c
+ * @author  lizdDong
+ * @version V1.0
+ * @date    2026-10-17
+ * @brief   A staged image starts with an iap_imageHeader_t, the payload
+ *          follows at IAP_IMAGE_HDR_SIZE. Ymodem programs the header with
+ *          the first page, a transfer broken after it leaves a payload whose
+ *          CRC32 does not match the header.
+ * @attention
+ *
+ ******************************************************************************
+ */
+
+#include "stm32f10x.h"
+#include "iap_cfg.h"
+#include "iap_image.h"
+
+
+/**
+ ****************************************************************************
+ * @brief  Get the header of the image in a slot.
+ * @author lizdDong
+ * @note   None
+ * @param  slot: The address of the slot.
+ * @param  size: The size of the slot.
+ * @retval The header, 0 if the slot has no valid header
+ ****************************************************************************
+*/
+const iap_imageHeader_t *iap_imageHeader(uint32_t slot, uint32_t size)
+{
+    const iap_imageHeader_t *header = (const iap_imageHeader_t *)slot;
+
+    if((header->magic != IAP_IMAGE_MAGIC) || (header->length == 0) ||
+       (header->length > size - IAP_IMAGE_HDR_SIZE))
+    {
+        return 0;
+    }
+    return header;
+}
+
+/**
+ ****************************************************************************
+ * @brief  CRC32 of a flash range with the CRC unit.
+ * @author lizdDong
+ * @note   CRC-32/MPEG-2 of the data taken as little endian words, the last
+ *         word padded with 0xFF.
+ * @param  addr: The starting address.(The address must be a multiple of four)
+ * @param  length: The number of byte(8bit).
+ * @retval The CRC32
+ ****************************************************************************
+*/
+uint32_t iap_imageCrc(uint32_t addr, uint32_t length)
+{
+    const uint32_t *pWord = (const uint32_t *)addr;
+    uint32_t i, last, crc;
+
+    RCC_AHBPeriphClockCmd(RCC_AHBPeriph_CRC, ENABLE);
+    CRC->CR = CRC_CR_RESET;
+    for(i = 0; i < length / 4; i++)
+    {
+        CRC->DR = pWord[i];
+    }
+    if((length & 0x00000003) != 0)
+    {
+        last = 0xFFFFFFFF;
+        for(i = 0; i < (length & 0x00000003); i++)
+        {
+            last &= ~((uint32_t)0xFF << (i * 8));
+            last |= (uint32_t)((const uint8_t *)&pWord[length / 4])[i] << (i * 8);
+        }
+        CRC->DR = last;
+    }
+    crc = CRC->DR;
+    RCC_AHBPeriphClockCmd(RCC_AHBPeriph_CRC, DISABLE);
+    return crc;
+}
+
+/**
+ ****************************************************************************
+ * @brief  Check the image of a slot is linked to run there.
+ * @author lizdDong
+ * @note   The reset vector of the payload must point into the slot, an
+ *         image linked for the other slot would fault at each boot.
+ * @param  slot: The address of the slot.
+ * @retval 1: Linked for the slot, 0: not
+ ****************************************************************************
+*/
+uint32_t iap_imageLinked(uint32_t slot)
+{
+    uint32_t reset = *(const uint32_t *)(slot + IAP_IMAGE_HDR_SIZE + 4);
+
+    return ((reset >= slot + IAP_IMAGE_HDR_SIZE) && (reset < slot + FLASH_IMAGE_SIZE)) ? 1 : 0;
+}
+
+/**
+ ****************************************************************************
+ * @brief  Get the slot holding the newest valid image.
+ * @author lizdDong
+ * @note   An image is valid when its header is, its payload is not
+ *         compressed, linked for its slot, and the CRC32 of the payload
+ *         matches. The highest version wins, slot A on a tie.
+ * @param  None
+ * @retval The address of the slot, 0 if no slot is valid
+ ****************************************************************************
+*/
+uint32_t iap_imageNewest(void)
+{
+    static const uint32_t slot[2] = {IAP_APP_ADDR, IAP_IMAGE_ADDR};
+    const iap_imageHeader_t *header, *newest = 0;
+    uint32_t i, select = 0;
+
+    for(i = 0; i < 2; i++)
+    {
+        header = iap_imageHeader(slot[i], IAP_APP_SIZE);
+        if((header != 0) && ((header->flags & IAP_IMAGE_FLAG_LZ) == 0) &&
+           ((newest == 0) || (header->version > newest->version)) &&
+           (iap_imageLinked(slot[i]) != 0) &&
+           (iap_imageCrc(slot[i] + IAP_IMAGE_HDR_SIZE, header->length) == header->crc32))
+        {
+            newest = header;
+            select = slot[i];
+        }
+    }
+    return select;
+}
+
+/**
+ ****************************************************************************
+ * @brief  Get the slot a new image is received into.
+ * @author lizdDong
+ * @note   The slot iap_imageNewest() does not boot, so the running image
+ *         stays valid until the new one is complete. IAP_IMAGE_ADDR when
+ *         no slot is valid, an application without header at IAP_APP_ADDR
+ *         is kept.
+ * @param  None
+ * @retval The address of the slot
+ ****************************************************************************
+*/
+uint32_t iap_imageTarget(void)
+{
+    return (iap_imageNewest() == IAP_IMAGE_ADDR) ? IAP_APP_ADDR : IAP_IMAGE_ADDR;
+}
+
+
+/****************************** End of file ***********************************/
+
@@ -0,0 +1,48 @@
+/**
+  ******************************************************************************
+  * @file    iap_image.h
+  * @author  lizdDong
+  * @version V1.0
+  * @date    2026-10-17
+  * @brief   Header of the image staged at IAP_IMAGE_ADDR.
+  * @attention
+  *
+  ******************************************************************************
+  */
+
+#ifndef _IAP_IMAGE_H_
+#define _IAP_IMAGE_H_
+
+#include <stdint.h>
+
+
+#define IAP_IMAGE_MAGIC          ((uint32_t)0x31474D49)    /* "IMG1" */
+
+/* The payload follows the header at IAP_IMAGE_HDR_SIZE, a vector table
+   boundary */
+#define IAP_IMAGE_HDR_SIZE       ((uint32_t)0x200)
+
+/* iap_imageHeader_t flags */
+#define IAP_IMAGE_FLAG_LZ        ((uint32_t)0x00000001)    /* payload compressed, see iap_lz.c */
+
+typedef struct
+{
+    uint32_t magic;         /* IAP_IMAGE_MAGIC */
+    uint32_t length;        /* bytes of the payload */
+    uint32_t crc32;         /* iap_imageCrc() of the payload */
+    uint32_t version;
+    uint32_t flags;         /* IAP_IMAGE_FLAG_xxx */
+    uint32_t raw_length;    /* with IAP_IMAGE_FLAG_LZ, bytes of the application */
+    uint32_t raw_crc32;     /* with IAP_IMAGE_FLAG_LZ, iap_imageCrc() of them */
+} iap_imageHeader_t;
+
+
+const iap_imageHeader_t *iap_imageHeader(uint32_t slot, uint32_t size);
+uint32_t iap_imageCrc(uint32_t addr, uint32_t length);
+uint32_t iap_imageLinked(uint32_t slot);
+uint32_t iap_imageNewest(void);
+uint32_t iap_imageTarget(void);
+
+
+#endif
+
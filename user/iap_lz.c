@@ -0,0 +1,121 @@
+/**
+ ******************************************************************************
+ * @file    iap_lz.c
+ * @author  lizdDong
+ * @version V1.0
+ * @date    2026-10-17
+ * @brief   Decoder of the heatshrink format (LZSS), the image is compressed
+ *          with "heatshrink -e -w IAP_LZ_WINDOW -l IAP_LZ_LOOKAHEAD". The
+ *          bits are read MSB first: a tag bit, 1 followed by an 8 bits
+ *          literal, 0 followed by the IAP_LZ_WINDOW bits distance - 1 and
+ *          the IAP_LZ_LOOKAHEAD bits length - 1 of a back reference. The
+ *          only RAM is the window, the input and the output are streamed.
+ * @attention
+ *
+ ******************************************************************************
+ */
+
+#include <string.h>
+#include "iap_lz.h"
+
+
+#define IAP_LZ_TAG               (0)
+#define IAP_LZ_LITERAL           (1)
+#define IAP_LZ_INDEX             (2)
+#define IAP_LZ_COUNT             (3)
+#define IAP_LZ_COPY              (4)
+
+#if (IAP_LZ_WINDOW < 4) || (IAP_LZ_WINDOW > 15) || (IAP_LZ_LOOKAHEAD < 3) || (IAP_LZ_LOOKAHEAD >= IAP_LZ_WINDOW)
+#error "heatshrink needs 4 <= IAP_LZ_WINDOW <= 15 and 3 <= IAP_LZ_LOOKAHEAD < IAP_LZ_WINDOW."
+#endif
+
+/**
+ ****************************************************************************
+ * @brief  Start a new stream.
+ * @author lizdDong
+ * @note   The window starts with zeros, as in heatshrink.
+ * @param  lz: The decoder.
+ * @retval None
+ ****************************************************************************
+*/
+void iap_lzInit(iap_lz_t *lz)
+{
+    memset(lz, 0, sizeof(*lz));
+    lz->state = IAP_LZ_TAG;
+}
+
+/**
+ ****************************************************************************
+ * @brief  Decode the next bytes of the stream.
+ * @author lizdDong
+ * @note   Stops when pOut is full or the input is used up, the next call
+ *         goes on from there with more input or output. The stream has no
+ *         end mark, the caller knows the decoded length.
+ * @param  lz: The decoder.
+ * @param  ppIn: The pointer to the input, moved past the bytes used.
+ * @param  pInSize: The number of input bytes, decreased by the bytes used.
+ * @param  pOut: The pointer to the output.
+ * @param  outSize: The room in pOut.
+ * @retval The number of bytes decoded to pOut
+ ****************************************************************************
+*/
+uint32_t iap_lzDecode(iap_lz_t *lz, const uint8_t **ppIn, uint32_t *pInSize, uint8_t *pOut, uint32_t outSize)
+{
+    static const uint8_t width[] = {1, 8, IAP_LZ_WINDOW, IAP_LZ_LOOKAHEAD};
+    uint32_t n = 0, need, value;
+    uint8_t c;
+
+    while(n < outSize)
+    {
+        if(lz->state == IAP_LZ_COPY)
+        {
+            c = lz->window[(lz->head - lz->index) & (IAP_LZ_WINDOW_SIZE - 1)];
+            lz->window[lz->head++ & (IAP_LZ_WINDOW_SIZE - 1)] = c;
+            pOut[n++] = c;
+            if(--lz->count == 0)
+            {
+                lz->state = IAP_LZ_TAG;
+            }
+            continue;
+        }
+
+        need = width[lz->state];
+        while(lz->bitCount < need)
+        {
+            if(*pInSize == 0)
+            {
+                return n;
+            }
+            lz->bits = (lz->bits << 8) | *(*ppIn)++;
+            (*pInSize)--;
+            lz->bitCount += 8;
+        }
+        lz->bitCount -= need;
+        value = (lz->bits >> lz->bitCount) & ((1u << need) - 1);
+
+        switch(lz->state)
+        {
+            case IAP_LZ_TAG:
+                lz->state = (value != 0) ? IAP_LZ_LITERAL : IAP_LZ_INDEX;
+                break;
+            case IAP_LZ_LITERAL:
+                lz->window[lz->head++ & (IAP_LZ_WINDOW_SIZE - 1)] = (uint8_t)value;
+                pOut[n++] = (uint8_t)value;
+                lz->state = IAP_LZ_TAG;
+                break;
+            case IAP_LZ_INDEX:
+                lz->index = value + 1;
+                lz->state = IAP_LZ_COUNT;
+                break;
+            default:
+                lz->count = value + 1;
+                lz->state = IAP_LZ_COPY;
+                break;
+        }
+    }
+    return n;
+}
+
+
+/****************************** End of file ***********************************/
+
@@ -0,0 +1,39 @@
+/**
+  ******************************************************************************
+  * @file    iap_lz.h
+  * @author  lizdDong
+  * @version V1.0
+  * @date    2026-10-17
+  * @brief   Streaming decoder of heatshrink compressed images.
+  * @attention
+  *
+  ******************************************************************************
+  */
+
+#ifndef _IAP_LZ_H_
+#define _IAP_LZ_H_
+
+#include <stdint.h>
+#include "iap_cfg.h"
+
+
+#define IAP_LZ_WINDOW_SIZE       (1u << IAP_LZ_WINDOW)
+
+typedef struct
+{
+    uint8_t window[IAP_LZ_WINDOW_SIZE];     /* last bytes decoded */
+    uint32_t head;          /* next byte of window[] */
+    uint32_t state;         /* field expected next */
+    uint32_t bits;          /* input bits not used yet, the low bitCount */
+    uint32_t bitCount;
+    uint32_t index;         /* distance of the back reference */
+    uint32_t count;         /* bytes left of the back reference */
+} iap_lz_t;
+
+
+void iap_lzInit(iap_lz_t *lz);
+uint32_t iap_lzDecode(iap_lz_t *lz, const uint8_t **ppIn, uint32_t *pInSize, uint8_t *pOut, uint32_t outSize);
+
+
+#endif
+
@@ -0,0 +1,169 @@
+/**
+ ******************************************************************************
+ * @file    iap_state.c
+ * @author  lizdDong
+ * @version V1.0
+ * @date    2026-10-17
+ * @brief   The boot state is an append-only journal of half word records in
+ *          the page at IAP_FLAG_ADDR. Slot 0 belongs to the application,
+ *          see iap_state.h. The bootloader programs a new state in the first
+ *          blank slot after it and the last valid record wins. Clearing the
+ *          state is a record as well, the page is only erased when it is
+ *          full and compacted through the spare page at IAP_STATE_SPARE_ADDR.
+ * @attention
+ *
+ ******************************************************************************
+ */
+
+#include "stm32f10x.h"
+#include "iap_cfg.h"
+#include "iap_state.h"
+
+
+#define IAP_STATE_SLOTS          (PAGE_SIZE / 2)
+
+/**
+ ****************************************************************************
+ * @brief  Scan the records of a journal page.
+ * @author lizdDong
+ * @note   A record broken by a power loss is not valid and is skipped.
+ * @param  addr: The page, IAP_FLAG_ADDR or IAP_STATE_SPARE_ADDR.
+ * @param  first: The first slot scanned.
+ * @param  state: The pointer to save the last valid record, not changed if
+ *                there is none.
+ * @retval The first blank slot, IAP_STATE_SLOTS if the page is full
+ ****************************************************************************
+*/
+static uint32_t iap_stateScan(uint32_t addr, uint32_t first, uint16_t *state)
+{
+    const uint16_t *pSlot = (const uint16_t *)addr;
+    uint32_t i;
+
+    for(i = first; (i < IAP_STATE_SLOTS) && (pSlot[i] != 0xFFFF); i++)
+    {
+        if(IAP_STATE_VALID(pSlot[i]))
+        {
+            *state = pSlot[i];
+        }
+    }
+    return i;
+}
+
+/**
+ ****************************************************************************
+ * @brief  Get the boot state.
+ * @author lizdDong
+ * @note   A record in the spare page means a compaction was broken. It is
+ *         newer than the journal page while that page is still full or
+ *         blank, once a record is written in the erased page, by the
+ *         bootloader or the application, the journal page wins.
+ * @param  None
+ * @retval The last valid record, IAP_STATE_NONE if there is none
+ ****************************************************************************
+*/
+uint16_t iap_stateRead(void)
+{
+    uint16_t state = IAP_STATE_NONE;
+    uint32_t slot;
+
+    if(*(__IO uint16_t *)IAP_FLAG_ADDR == IAP_FLAG)
+    {
+        state = IAP_FLAG;
+    }
+    slot = iap_stateScan(IAP_FLAG_ADDR, 1, &state);
+    if((slot == IAP_STATE_SLOTS) || ((slot == 1) && (*(__IO uint16_t *)IAP_FLAG_ADDR == 0xFFFF)))
+    {
+        iap_stateScan(IAP_STATE_SPARE_ADDR, 0, &state);
+    }
+    return state;
+}
+
+/**
+ ****************************************************************************
+ * @brief  Program one record and read it back.
+ * @author lizdDong
+ * @note   None
+ * @param  addr: The slot.
+ * @param  state: The record.
+ * @retval 0: Done
+ *        -1: Flash error
+ ****************************************************************************
+*/
+static int32_t iap_stateProgram(uint32_t addr, uint16_t state)
+{
+    if((dev_flashProgram(addr, (const uint8_t *)&state, 2) != 0) ||
+       (dev_flashCompare(addr, (const uint8_t *)&state, 2) != FLASH_CMP_SAME))
+    {
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ ****************************************************************************
+ * @brief  Set the boot state.
+ * @author lizdDong
+ * @note   One half word is programmed, IAP_STATE_NONE included. When the
+ *         page is full, or a compaction was broken, the state is first
+ *         appended to the spare page, then the journal page is erased and
+ *         the state programmed in its slot 1, and the spare page is erased
+ *         last. A power loss at any point leaves either the previous or the
+ *         new state readable. Nothing is written if the state is the same.
+ * @param  state: The new state, IAP_STATE_VALID() must be true.
+ * @retval 0: Done
+ *        -1: Invalid state or flash error
+ ****************************************************************************
+*/
+int32_t iap_stateWrite(uint16_t state)
+{
+    uint16_t spare_state = IAP_STATE_NONE;
+    uint32_t slot, spare;
+    int32_t result = 0;
+
+    if(!IAP_STATE_VALID(state))
+    {
+        return -1;
+    }
+    if(iap_stateRead() == state)
+    {
+        return 0;
+    }
+    slot = iap_stateScan(IAP_FLAG_ADDR, 1, &spare_state);
+    spare = iap_stateScan(IAP_STATE_SPARE_ADDR, 0, &spare_state);
+
+    if((slot < IAP_STATE_SLOTS) && (spare == 0))
+    {
+        result = iap_stateProgram(IAP_FLAG_ADDR + slot * 2, state);
+    }
+    else
+    {
+        /* Compaction, the spare page is never full: it only keeps the
+           records of broken compactions */
+        if(spare >= IAP_STATE_SLOTS)
+        {
+            result = dev_flashErasePage(IAP_STATE_SPARE_ADDR);
+            spare = 0;
+        }
+        if(result == 0)
+        {
+            result = iap_stateProgram(IAP_STATE_SPARE_ADDR + spare * 2, state);
+        }
+        if(result == 0)
+        {
+            result = dev_flashErasePage(IAP_FLAG_ADDR);
+        }
+        if(result == 0)
+        {
+            result = iap_stateProgram(IAP_FLAG_ADDR + 2, state);
+        }
+        if(result == 0)
+        {
+            result = dev_flashErasePage(IAP_STATE_SPARE_ADDR);
+        }
+    }
+
+    return (result != 0) ? -1 : 0;
+}
+
+
+/****************************** End of file ***********************************/
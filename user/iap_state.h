@@ -0,0 +1,45 @@
+/**
+  ******************************************************************************
+  * @file    iap_state.h
+  * @author  lizdDong
+  * @version V1.0
+  * @date    2026-10-17
+  * @brief   Boot state journal in the page at IAP_FLAG_ADDR.
+  * @attention
+  *
+  ******************************************************************************
+  */
+
+#ifndef _IAP_STATE_H_
+#define _IAP_STATE_H_
+
+#include <stdint.h>
+
+
+/* Application protocol: to ask for the copy of the image at the next
+   boot, the application programs the half word IAP_FLAG in the first blank
+   slot after slot 0 of the page at IAP_FLAG_ADDR. When there is none it
+   erases the page and programs IAP_FLAG at IAP_FLAG_ADDR (slot 0), as the
+   applications written for the single flag do. Slot 0 is reserved for
+   that, the bootloader appends its records from slot 1, IAP_STATE_NONE
+   included. IAP_FLAG in slot 0 with no record after it is read as IAP_FLAG.
+   The application must not touch the spare page at IAP_STATE_SPARE_ADDR.
+
+   A record is one half word, the high byte is the complement of the low
+   byte. IAP_FLAG (0xA55A) is a valid record. */
+#define IAP_STATE_VALID(s)       ((((s) >> 8) & 0xFF) == (~(s) & 0xFF))
+#define IAP_STATE_NONE           ((uint16_t)0xFF00)
+
+/* Copy of the image to the application in progress, n (0..127) pages done,
+   IAP_APP_SIZE is 48 pages on the STM32F103xC */
+#define IAP_STATE_COPY(n)        ((uint16_t)(((~(0x80 + (n)) & 0xFF) << 8) | (0x80 + (n))))
+#define IAP_STATE_IS_COPY(s)     (IAP_STATE_VALID(s) && (((s) & 0x80) != 0))
+#define IAP_STATE_COPY_PAGES(s)  ((s) & 0x7F)
+
+
+uint16_t iap_stateRead(void);
+int32_t iap_stateWrite(uint16_t state);
+
+
+#endif
+
@@ -17,17 +17,36 @@
 #include "ymodem.h"
 #include "iap_cfg.h"
 #include "dev_flash.h"
+#include "dev_uart.h"
+#include "dev_timer.h"
+#include "iap_state.h"
+#include "iap_image.h"
+#include "iap_lz.h"
 
 
-uint8_t gaRecvData[1024] = {0};
-uint8_t gaFlashTemp[2048];
+uint32_t gaRecvData[YMODEM_RECV_BUF_SIZE / 4] = {0};
+uint32_t gaFlashTemp[2048 / 4];
 __IO uint32_t gMsCounter = 0;
+static uint32_t gRunAppDeadline;
+#if (FLASH_PROFILE_EN)
+static __IO uint32_t gIrqLatencyMax;    /* worst lateness of SysTick_Handler, in cycles */
+static __IO uint32_t gSysTickCycles;    /* DWT->CYCCNT at the last SysTick_Handler */
+#endif
+#if (FLASH_RAM_FUNC_EN)
+/* 16 system + 60 STM32F10x HD vectors, VTOR needs a power of two alignment */
+#define RAM_VECTOR_NUM    (16 + 60)
+static uint32_t gaRamVector[RAM_VECTOR_NUM] __attribute__((aligned(512)));
+#endif
 
 static void uart_init(void);
 static void io_init(void);
 static void systick_init(void);
 static int32_t app_run(void);
-static void flash_copy(uint32_t destination, uint32_t source, uint32_t size);
+#if (UPGRADE_FROM_IMAGE)
+static int32_t flash_copy(uint32_t destination, uint32_t source, uint32_t size, uint32_t start);
+static int32_t flash_unpack(uint32_t destination, uint32_t source, uint32_t size, uint32_t length, uint32_t start);
+static int32_t image_apply(void);
+#endif
 #if (USE_RS485_PORT)
 static void RS485_InitTXE(void);
 #endif
@@ -35,6 +54,10 @@ static void RS485_InitTXE(void);
 static void uart_deinit(void);
 static void systick_deinit(void);
 static void io_deinit(void);
+#if (FLASH_RAM_FUNC_EN)
+static void vector_init(void);
+static void vector_deinit(void);
+#endif
 
 
 
@@ -49,6 +72,9 @@ static void io_deinit(void);
 */
 void init_all(void)
 {
+#if (FLASH_RAM_FUNC_EN)
+    vector_init();
+#endif
     io_init();  // ҪĿǽJTAG2˿PA15PB4ΪͣĬΪߣ
     uart_init();
     systick_init();
@@ -68,6 +94,9 @@ void deinit_all(void)
     systick_deinit();
     uart_deinit();
     io_deinit();
+#if (FLASH_RAM_FUNC_EN)
+    vector_deinit();
+#endif
 }
 
 /**
@@ -92,7 +121,7 @@ void print_msg(void)
     printf(" Key <F2>  upgrede via Ymodem.           \r\n");
     printf(" Key <F3>  forced to upgrede from image! \r\n");
     printf("=========================================\r\n");
-    gMsCounter = 0;
+    gRunAppDeadline = dev_timerDeadline(1000 * RUN_APP_DELAY_S);
 }
 
 /**
@@ -121,7 +150,13 @@ void run_app_failed(void)
 int main(void)
 {
     uint8_t c, step = 0, get_key_f1 = 0, get_key_f2 = 0, get_key_f3 = 0;
+#if (UPGRADE_FROM_IMAGE)
     uint16_t iap_flag;
+#endif
+#if (IAP_DUAL_SLOT)
+    uint32_t slot;
+#endif
+    int32_t size;
     
     init_all();
     print_msg();
@@ -167,7 +202,27 @@ int main(void)
             {
                 get_key_f2 = 0;
                 printf(" Waiting upgrade via Ymodem, key <a> to abort.\r\n");
-                if(Ymodem_Receive(gaRecvData) > 0)
+#if (IAP_DUAL_SLOT)
+                /* The image must be linked for the slot it is received into */
+                slot = iap_imageTarget();
+                printf(" Receive slot: 0x%08X, link the application at 0x%08X\r\n", slot, slot + IAP_IMAGE_HDR_SIZE);
+#endif
+                /* Ymodem_Receive() programs the flash without the cache */
+                dev_flashSync();
+#if (FLASH_PROFILE_EN)
+                dev_flashProfileReset();
+                gSysTickCycles = DWT->CYCCNT;
+                gIrqLatencyMax = 0;
+#endif
+                size = Ymodem_Receive((uint8_t *)gaRecvData);
+                printf("\r\n Packets: %d, CRC rejects: %d, Blank pages: %d, Skipped pages: %d, Rewritten pages: %d\r\n",
+                       YmodemStat.packets, YmodemStat.crc_errors, YmodemStat.blank_pages, YmodemStat.skipped_pages,
+                       YmodemStat.rewritten_pages);
+#if (FLASH_PROFILE_EN)
+                printf(" Program: %d cycles/KB, Compare: %d cycles/KB, IRQ latency max: %d cycles\r\n",
+                       dev_flashCyclesPerKB(), dev_flashCompareCyclesPerKB(), gIrqLatencyMax);
+#endif
+                if(size > 0)
                 {
                     if(app_run() < 0)
                     {
@@ -187,28 +242,20 @@ int main(void)
 #if (UPGRADE_FROM_IMAGE)
 
                 get_key_f3 = 0;
-                printf("Upgrade from image ...\r\n");
-                printf("Image address: 0x%08X\r\n", IAP_IMAGE_ADDR);
-                flash_copy(IAP_APP_ADDR, IAP_IMAGE_ADDR, IAP_APP_SIZE);
-                iap_flag = 0xFFFF;
-                dev_flashWrite(IAP_FLAG_ADDR, (uint8_t *)&iap_flag, 2);
+                image_apply();
 
 #endif
             }
         }
 
-        if(gMsCounter > 1000 * RUN_APP_DELAY_S)
+        if(dev_timerExpired(gRunAppDeadline))
         {
 #if (UPGRADE_FROM_IMAGE)
 
-            dev_flashRead(IAP_FLAG_ADDR, (uint8_t *)&iap_flag, 2);
-            if(iap_flag == IAP_FLAG)
+            iap_flag = iap_stateRead();
+            if((iap_flag == IAP_FLAG) || IAP_STATE_IS_COPY(iap_flag))
             {
-                printf("Upgrade from image ...\r\n");
-                printf("Image address: 0x%08X\r\n", IAP_IMAGE_ADDR);
-                flash_copy(IAP_APP_ADDR, IAP_IMAGE_ADDR, IAP_APP_SIZE);
-                iap_flag = 0xFFFF;
-                dev_flashWrite(IAP_FLAG_ADDR, (uint8_t *)&iap_flag, 2);
+                image_apply();
             }
 
 #endif
@@ -234,18 +281,33 @@ int main(void)
 static int32_t app_run(void)
 {
     uint32_t appAddress;
+    uint32_t appBase = ApplicationAddress;
     pFunction application;
+#if (IAP_DUAL_SLOT)
+    uint32_t slot;
+
+    slot = iap_imageNewest();
+    if(slot != 0)
+    {
+        appBase = slot + IAP_IMAGE_HDR_SIZE;
+        printf("Slot: 0x%08X, version: %d\r\n", slot, ((const iap_imageHeader_t *)slot)->version);
+    }
+#endif
 
     printf("Run application >>>>>>>> \r\n");
+    dev_flashSync();
     deinit_all();
     __disable_irq();
-    if(((*(__IO uint32_t *)ApplicationAddress) & 0x2FFE0000) == 0x20000000) //жûǷѾس򣬷ֹܷ
+    if(((*(__IO uint32_t *)appBase) & 0x2FFE0000) == 0x20000000) //жûǷѾس򣬷ֹܷ
     {
         //תû
-        appAddress = *(__IO uint32_t *)(ApplicationAddress + 4);
+        appAddress = *(__IO uint32_t *)(appBase + 4);
         application = (pFunction)appAddress;
+#if (IAP_DUAL_SLOT)
+        SCB->VTOR = appBase;
+#endif
         //ʼûĶջָ
-        __set_MSP(*(__IO uint32_t *)ApplicationAddress);
+        __set_MSP(*(__IO uint32_t *)appBase);
         __enable_irq();
         application();
     }
@@ -254,23 +316,41 @@ static int32_t app_run(void)
     return (-1);
 }
 
+#if (UPGRADE_FROM_IMAGE)
 /**
  ****************************************************************************
- * @brief  None
+ * @brief  Copy the image slot to the application slot.
  * @author lizdDong
- * @note   None
- * @param  None
- * @retval None
+ * @note   Each chunk is written by dev_flashWrite() and flushed, then the
+ *         page done is recorded in the boot state journal as
+ *         IAP_STATE_COPY(), a copy broken by a power loss resumes at the
+ *         page being written. That page is compared again and rewritten.
+ * @param  destination: The application address, page aligned.
+ * @param  source: The image address.
+ * @param  size: The number of byte copied(8bit).
+ * @param  start: The number of byte already copied, a multiple of PAGE_SIZE.
+ * @retval 0: Copied
+ *        -1: Write error, the copy stopped at the failed chunk
  ****************************************************************************
 */
-static void flash_copy(uint32_t destination, uint32_t source, uint32_t size)
+static int32_t flash_copy(uint32_t destination, uint32_t source, uint32_t size, uint32_t start)
 {
     uint32_t addr_d, addr_s, addr_inc, count;
+    int32_t status = 0;
 
+#if (FLASH_PROFILE_EN)
+    dev_flashProfileReset();
+#endif
+    /* dev_flashCompare() reads the flash, not the cache */
+    dev_flashSync();
+    if(start > size)
+    {
+        start = size;
+    }
     addr_inc = sizeof(gaFlashTemp);
-    addr_d = IAP_APP_ADDR;
-    addr_s = IAP_IMAGE_ADDR;
-    count = 0;
+    addr_d = destination + start;
+    addr_s = source + start;
+    count = start;
 
     while(count < size)
     {
@@ -283,16 +363,183 @@ static void flash_copy(uint32_t destination, uint32_t source, uint32_t size)
             addr_inc = size - count;
         }
 
-        dev_flashRead(addr_s, gaFlashTemp, addr_inc);
-        dev_flashWrite(addr_d, gaFlashTemp, addr_inc);
+        dev_flashRead(addr_s, (uint8_t *)gaFlashTemp, addr_inc);
+        /* Rewrite only what changed */
+        if((dev_flashCompare(addr_d, (uint8_t *)gaFlashTemp, addr_inc) != FLASH_CMP_SAME) &&
+           ((dev_flashWrite(addr_d, (uint8_t *)gaFlashTemp, addr_inc) != addr_inc) || (dev_flashFlush() != 0)))
+        {
+            status = -1;
+            break;
+        }
         addr_s += addr_inc;
         addr_d += addr_inc;
         count += addr_inc;
+        if((count < size) && ((count % PAGE_SIZE) == 0))
+        {
+            iap_stateWrite(IAP_STATE_COPY(count / PAGE_SIZE));
+        }
 
         printf("Progress: %d%%   \r", count * 100 / size);
     }
+    dev_flashFlush();
     printf("\n");
+#if (FLASH_PROFILE_EN)
+    printf("Erases: %d, Read: %d cycles/KB, Compare: %d cycles/KB\r\n",
+           dev_flashEraseCount(), dev_flashReadCyclesPerKB(), dev_flashCompareCyclesPerKB());
+#endif
+    return status;
+}
+/**
+ ****************************************************************************
+ * @brief  Decompress the image slot to the application slot.
+ * @author lizdDong
+ * @note   The output is programmed by chunks of gaFlashTemp, one page, and
+ *         recorded in the journal as flash_copy() does. A broken copy is
+ *         decoded again from the start, the pages before start are not
+ *         written.
+ * @param  destination: The application address, page aligned.
+ * @param  source: The compressed payload.
+ * @param  size: The number of byte of the payload(8bit).
+ * @param  length: The number of byte decompressed(8bit).
+ * @param  start: The number of byte already copied, a multiple of PAGE_SIZE.
+ * @retval 0: Decompressed
+ *        -1: Write error, the copy stopped at the failed chunk
+ ****************************************************************************
+*/
+static int32_t flash_unpack(uint32_t destination, uint32_t source, uint32_t size, uint32_t length, uint32_t start)
+{
+    static iap_lz_t lz;
+    const uint8_t *pIn = (const uint8_t *)source;
+    uint32_t count = 0, n;
+    int32_t status = 0;
+
+#if (FLASH_PROFILE_EN)
+    dev_flashProfileReset();
+#endif
+    /* dev_flashCompare() reads the flash, not the cache */
+    dev_flashSync();
+    iap_lzInit(&lz);
+
+    while(count < length)
+    {
+        n = (length - count < sizeof(gaFlashTemp)) ? (length - count) : sizeof(gaFlashTemp);
+        n = iap_lzDecode(&lz, &pIn, &size, (uint8_t *)gaFlashTemp, n);
+        if(n == 0)
+        {
+            /* Truncated payload, the CRC check fails */
+            break;
+        }
+        if((n & 1) != 0)
+        {
+            /* Last byte, dev_flashWrite() writes half words */
+            ((uint8_t *)gaFlashTemp)[n] = 0xFF;
+        }
+        if((count >= start) &&
+           (dev_flashCompare(destination + count, (uint8_t *)gaFlashTemp, (n + 1) & ~1u) != FLASH_CMP_SAME) &&
+           ((dev_flashWrite(destination + count, (uint8_t *)gaFlashTemp, (n + 1) & ~1u) != ((n + 1) & ~1u)) ||
+            (dev_flashFlush() != 0)))
+        {
+            status = -1;
+            break;
+        }
+        count += n;
+        if((count > start) && (count < length) && ((count % PAGE_SIZE) == 0))
+        {
+            iap_stateWrite(IAP_STATE_COPY(count / PAGE_SIZE));
+        }
+
+        printf("Progress: %d%%   \r", count * 100 / length);
+    }
+    dev_flashFlush();
+    printf("\n");
+#if (FLASH_PROFILE_EN)
+    printf("Erases: %d, Read: %d cycles/KB, Compare: %d cycles/KB\r\n",
+           dev_flashEraseCount(), dev_flashReadCyclesPerKB(), dev_flashCompareCyclesPerKB());
+#endif
+    return status;
+}
+/**
+ ****************************************************************************
+ * @brief  Copy the staged image to the application and clear the flag.
+ * @author lizdDong
+ * @note   With an iap_imageHeader_t only the payload is copied, its CRC32
+ *         is checked before and after, and the pages left of the previous
+ *         application are erased. An image without header is copied
+ *         whole as before. A payload with IAP_IMAGE_FLAG_LZ is decompressed
+ *         by flash_unpack(). A copy broken by a power loss resumes at the
+ *         page recorded in the journal. When the copy fails the flag is set
+ *         again, so it is done again from the start at the next boot.
+ * @param  None
+ * @retval 0: Copied
+ *        -1: Bad image, the application is not touched
+ *        -2: Copy failed
+ ****************************************************************************
+*/
+static int32_t image_apply(void)
+{
+    const iap_imageHeader_t *header;
+    uint32_t length, crc, end, start = 0;
+    uint16_t state;
+    int32_t status;
+
+    printf("Upgrade from image ...\r\n");
+    printf("Image address: 0x%08X\r\n", IAP_IMAGE_ADDR);
+    state = iap_stateRead();
+    if(IAP_STATE_IS_COPY(state))
+    {
+        start = IAP_STATE_COPY_PAGES(state) * PAGE_SIZE;
+        printf("Resume at: 0x%08X\r\n", IAP_APP_ADDR + start);
+    }
+    header = iap_imageHeader(IAP_IMAGE_ADDR, IAP_IMAGE_SIZE);
+    if(header == 0)
+    {
+        status = flash_copy(IAP_APP_ADDR, IAP_IMAGE_ADDR, IAP_APP_SIZE, start);
+        if((dev_flashSync() != 0) || (status != 0))
+        {
+            iap_stateWrite(IAP_FLAG);
+            return -2;
+        }
+        iap_stateWrite(IAP_STATE_NONE);
+        return 0;
+    }
+
+    printf("Image version: %d, length: %d\r\n", header->version, header->length);
+    length = header->length;
+    crc = header->crc32;
+    if((header->flags & IAP_IMAGE_FLAG_LZ) != 0)
+    {
+        length = header->raw_length;
+        crc = header->raw_crc32;
+    }
+    if((iap_imageCrc(IAP_IMAGE_ADDR + IAP_IMAGE_HDR_SIZE, header->length) != header->crc32) ||
+       (length == 0) || (length > IAP_APP_SIZE))
+    {
+        printf("Image CRC error.\r\n");
+        iap_stateWrite(IAP_STATE_NONE);
+        return -1;
+    }
+    if((header->flags & IAP_IMAGE_FLAG_LZ) != 0)
+    {
+        printf("Compressed: %d bytes\r\n", header->length);
+        status = flash_unpack(IAP_APP_ADDR, IAP_IMAGE_ADDR + IAP_IMAGE_HDR_SIZE, header->length, length, start);
+    }
+    else
+    {
+        status = flash_copy(IAP_APP_ADDR, IAP_IMAGE_ADDR + IAP_IMAGE_HDR_SIZE, (length + 3) & ~3u, start);
+    }
+    end = (IAP_APP_ADDR + length + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
+    if((dev_flashSync() != 0) || (status != 0) ||
+       ((end < IAP_APP_ADDR + IAP_APP_SIZE) && (dev_flashEraseRange(end, IAP_APP_ADDR + IAP_APP_SIZE - end, 0) != 0)) ||
+       (iap_imageCrc(IAP_APP_ADDR, length) != crc))
+    {
+        printf("Copy failed.\r\n");
+        iap_stateWrite(IAP_FLAG);
+        return -2;
+    }
+    iap_stateWrite(IAP_STATE_NONE);
+    return 0;
 }
+#endif
 
 /**
  ****************************************************************************
@@ -355,6 +602,45 @@ static void systick_deinit(void)
     SysTick->CTRL &= ~ SysTick_CTRL_ENABLE_Msk;
 }
 
+#if (FLASH_RAM_FUNC_EN)
+/**
+ ****************************************************************************
+ * @brief  Move the vector table to SRAM.
+ * @author lizdDong
+ * @note   An exception reads its vector from the table, so a table in flash
+ *         stalls every interrupt until an erase is over.
+ * @param  None
+ * @retval None
+ ****************************************************************************
+*/
+static void vector_init(void)
+{
+    uint32_t i;
+
+    for(i = 0; i < RAM_VECTOR_NUM; i++)
+    {
+        gaRamVector[i] = ((const uint32_t *)FLASH_BASE)[i];
+    }
+    SCB->VTOR = (uint32_t)gaRamVector;
+    __DSB();
+}
+
+/**
+ ****************************************************************************
+ * @brief  Put the vector table back in flash before running the application.
+ * @author lizdDong
+ * @note   None
+ * @param  None
+ * @retval None
+ ****************************************************************************
+*/
+static void vector_deinit(void)
+{
+    SCB->VTOR = FLASH_BASE;
+    __DSB();
+}
+#endif
+
 /**
  ****************************************************************************
  * @brief  None
@@ -403,7 +689,7 @@ static void uart_init(void)
 
 #endif
 
-    USART_InitStructure.USART_BaudRate = 115200;
+    USART_InitStructure.USART_BaudRate = COM_BAUDRATE;
     USART_InitStructure.USART_WordLength = USART_WordLength_8b;
     USART_InitStructure.USART_StopBits = USART_StopBits_1;
     USART_InitStructure.USART_Parity = USART_Parity_No;
@@ -411,6 +697,7 @@ static void uart_init(void)
     USART_InitStructure.USART_Mode = USART_Mode_Rx | USART_Mode_Tx;
     USART_Init(COM_PORT, &USART_InitStructure);
     USART_ClearFlag(COM_PORT, USART_FLAG_TC);
+    dev_uartInit();
     USART_Cmd(COM_PORT, ENABLE);
 
 #if (USE_RS485_PORT)
@@ -431,6 +718,7 @@ static void uart_deinit(void)
 {
     GPIO_InitTypeDef GPIO_InitStructure;
     
+    dev_uartDeinit();
     GPIO_InitStructure.GPIO_Mode = GPIO_Mode_IN_FLOATING;
     GPIO_InitStructure.GPIO_Pin = GPIO_Pin_9 | GPIO_Pin_10;
     GPIO_Init(GPIOA, &GPIO_InitStructure);
@@ -492,8 +780,10 @@ int fputc(int ch, FILE *f)
 */
 int fgetc(FILE *f)
 {
-    while(USART_GetFlagStatus(COM_PORT, USART_FLAG_RXNE) == RESET);
-    return (int)USART_ReceiveData(COM_PORT);
+    uint8_t c;
+
+    while(dev_uartGetc(&c) != 0);
+    return (int)c;
 }
 
 /**
@@ -505,7 +795,18 @@ int fgetc(FILE *f)
  * @retval None
  ****************************************************************************
 */
-void SysTick_Handler(void)
+RAM_FUNC void SysTick_Handler(void)
 {
+#if (FLASH_PROFILE_EN)
+    uint32_t now = DWT->CYCCNT;
+    int32_t late = (int32_t)(now - gSysTickCycles - (SysTick->LOAD + 1));
+
+    /* Time past the expected 1ms period since the last tick */
+    gSysTickCycles = now;
+    if((late > 0) && ((uint32_t)late > gIrqLatencyMax))
+    {
+        gIrqLatencyMax = late;
+    }
+#endif
     gMsCounter++;
 }